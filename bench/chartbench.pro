@@ -0,0 +1,28 @@
+QT += widgets concurrent
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = chartbench
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../chartaggregate.cpp \
+    ../chartexport.cpp \
+    ../chartfile.cpp \
+    ../chartlabels.cpp \
+    ../chartloader.cpp \
+    ../chartmodel.cpp \
+    ../chartprofiler.cpp \
+    ../pieview.cpp
+
+HEADERS += \
+    ../chartaggregate.h \
+    ../chartexport.h \
+    ../chartfile.h \
+    ../chartlabels.h \
+    ../chartloader.h \
+    ../chartmodel.h \
+    ../chartprofiler.h \
+    ../pieview.h
@@ -0,0 +1,348 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QStandardItemModel>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include "chartexport.h"
+#include "chartfile.h"
+#include "chartloader.h"
+#include "pieview.h"
+
+/* 统计堆分配次数。所有线程的分配都算在内。
+ * Qt的容器(QVector、QString、QByteArray、QImage等)通过QArrayData直接调用malloc，不经过operator new，
+ * 所以要在malloc这一层计数：glibc上在程序中定义malloc/calloc/realloc，动态链接时Qt库的调用也解析到这里，再转给glibc。
+ * 其他平台替换不了malloc，只能数operator new的次数，不包括Qt容器，输出中注明 */
+
+static std::atomic<qint64> allocations(0);
+
+#if defined(__GLIBC__)
+#define CHARTBENCH_COUNT_MALLOC
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+
+void *malloc(std::size_t size) noexcept
+{
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept
+{
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    return __libc_calloc(count,size);
+}
+
+//扩大或缩小已有的块也算一次，QVector、QByteArray追加时就是这样增长的
+void *realloc(void *p, std::size_t size) noexcept
+{
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    return __libc_realloc(p,size);
+}
+}
+
+static const char allocationUnit[] = "allocs/op";
+static const char allocationKey[] = "allocsPerOp";
+#else
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    if(void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static const char allocationUnit[] = "news/op";
+static const char allocationKey[] = "operatorNewCallsPerOp";
+#endif
+
+//一项测试的结果
+struct Result
+{
+    QString name;
+    int rows = 0;
+    qint64 iterations = 0;
+    double nsPerOp = 0;
+    double allocsPerOp = 0; //malloc的次数；不能替换malloc的平台上为operator new的次数
+    double mbPerSec = 0; //读写文件的测试才有
+};
+
+static QVector<Result> results;
+static qint64 minTime = 200; //每项至少运行的毫秒数
+
+//反复运行op，直到累计时间超过minTime。第一次不计时，用于预热缓存
+static void measure(const QString &name, int rows, const std::function<void()> &op, qint64 bytes = 0)
+{
+    op();
+    Result result;
+    result.name = name;
+    result.rows = rows;
+    const qint64 allocationsBefore = allocations.load();
+    QElapsedTimer timer;
+    timer.start();
+    do{
+        op();
+        ++result.iterations;
+    }while(timer.elapsed() < minTime);
+    const qint64 nsecs = timer.nsecsElapsed();
+    result.nsPerOp = double(nsecs) / result.iterations;
+    result.allocsPerOp = double(allocations.load() - allocationsBefore) / result.iterations;
+    if(bytes > 0)
+        result.mbPerSec = bytes / 1048576.0 / (result.nsPerOp / 1e9);
+    results.append(result);
+
+    std::printf("%-28s %9d rows %9lld ops %14.0f ns/op %12.1f %s",qPrintable(name),rows,result.iterations,result.nsPerOp,result.allocsPerOp,allocationUnit);
+    if(bytes > 0)
+        std::printf(" %9.1f MB/s",result.mbPerSec);
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+//合成rows行数据：5000种标签，数值和颜色按行号变化
+static ChartData makeData(int rows)
+{
+    ChartData data;
+    data.reserve(rows);
+    QVector<QString> labels;
+    for(int i = 0; i < qMin(rows,5000); ++i)
+        labels.append(QStringLiteral("Category %1").arg(i));
+    for(int row = 0; row < rows; ++row)
+        data.append(labels.at(row % labels.size()),(qint64(row) * 7919) % 1000 + 1 + row % 10 / 10.0,0xff100000u + (row * 2654435761u) % 0xefffff);
+    return data;
+}
+
+//旧的加载方式：逐行读取，每行insertRows再setData三次
+static int legacyLoad(const QString &fileName, QAbstractItemModel *model)
+{
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly | QFile::Text))
+        return 0;
+    QTextStream stream(&file);
+    model->removeRows(0,model->rowCount(QModelIndex()),QModelIndex());
+    int row = 0;
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine();
+        if(!line.isEmpty()){
+            model->insertRows(row,1,QModelIndex());
+            const QStringList pieces = line.split(QLatin1Char(','),Qt::SkipEmptyParts);
+            if(pieces.size() < 3)
+                continue;
+            model->setData(model->index(row,0,QModelIndex()),pieces.value(0));
+            model->setData(model->index(row,1,QModelIndex()),pieces.value(1));
+            model->setData(model->index(row,0,QModelIndex()),QColor(pieces.value(2)),Qt::DecorationRole);
+            row++;
+        }
+    }
+    return row;
+}
+
+//让测试能调用视图的保护成员
+class BenchView : public PieView
+{
+public:
+    using PieView::setSelection;
+    using PieView::visualRegionForSelection;
+};
+
+//加载、保存：MainWindow::loadFile和saveFile走的路径
+static void benchFiles(const QTemporaryDir &dir, int rows, const ChartData &data)
+{
+    const QString text = dir.filePath(QStringLiteral("sample%1.cht").arg(rows));
+    const QString binary = dir.filePath(QStringLiteral("sample%1.chtb").arg(rows));
+    if(!ChartFile::write(text,data) || !ChartFile::write(binary,data))
+        return;
+    const qint64 textBytes = QFile(text).size();
+    const qint64 binaryBytes = QFile(binary).size();
+
+    if(rows <= 200000){ //旧方式太慢，超过这个行数不再测
+        measure(QStringLiteral("load.legacy"),rows,[&]{
+            QStandardItemModel model(0,2);
+            legacyLoad(text,&model);
+        },textBytes);
+    }
+
+    for(int threads : {1,QThread::idealThreadCount()}){
+        measure(threads == 1 ? QStringLiteral("load.parse.1thread") : QStringLiteral("load.parse.allthreads"),rows,[&]{
+            QFile file(text);
+            if(!file.open(QFile::ReadOnly))
+                return;
+            const char *begin = reinterpret_cast<const char *>(file.map(0,file.size()));
+            const char *end = begin + file.size();
+            QTextCodec *codec = ChartFile::detectCodec(&begin,end);
+            ChartData parsed;
+            ChartLoadStats stats;
+            ChartFile::parseParallel(begin,end,codec,&parsed,&stats,threads);
+        },textBytes);
+    }
+
+    measure(QStringLiteral("load.binary"),rows,[&]{
+        ChartData loaded;
+        ChartLoadStats stats;
+        ChartFile::read(binary,&loaded,&stats);
+    },binaryBytes);
+
+    //MainWindow::loadFile：后台线程解析，定时器分批交给模型
+    measure(QStringLiteral("load.loader"),rows,[&]{
+        ChartModel model;
+        ChartLoader loader(&model);
+        QEventLoop loop;
+        QObject::connect(&loader,&ChartLoader::finished,&loop,&QEventLoop::quit);
+        QObject::connect(&loader,&ChartLoader::failed,&loop,&QEventLoop::quit);
+        loader.load(text);
+        loop.exec();
+    },textBytes);
+
+    //MainWindow::saveFile
+    const QString saved = dir.filePath(QStringLiteral("saved%1").arg(rows));
+    measure(QStringLiteral("save.text"),rows,[&]{ ChartFile::write(saved + QStringLiteral(".cht"),data); },textBytes);
+    measure(QStringLiteral("save.binary"),rows,[&]{ ChartFile::write(saved + QStringLiteral(".chtb"),data); },binaryBytes);
+}
+
+//视图：离屏绘制、命中测试、橡皮筋选择和选择区域
+static void benchView(int rows, const ChartData &data)
+{
+    ChartModel model;
+    model.setChartData(ChartData(data));
+    BenchView view;
+    view.setFrameShape(QFrame::NoFrame);
+    view.setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setModel(&model);
+    view.resize(600,320);
+    QImage image(view.size(),QImage::Format_ARGB32_Premultiplied);
+
+    //缓存层有效时的一帧
+    measure(QStringLiteral("paint.cached"),rows,[&]{ view.viewport()->render(&image); });
+    //修改颜色后缓存层要重画
+    bool toggle = false;
+    measure(QStringLiteral("paint.coloredit"),rows,[&]{
+        toggle = !toggle;
+        model.setData(model.index(0,0),toggle ? QColor(Qt::red) : QColor(Qt::blue),Qt::DecorationRole);
+        view.viewport()->render(&image);
+    });
+
+    //同一模型上再加一个视图：汇总已经由第一个视图算好，新视图只取得共享的那份
+    measure(QStringLiteral("view.attach"),rows,[&]{
+        PieView extra;
+        extra.setModel(&model);
+    });
+
+    //放大8倍导出：单线程整张画和分块并行画
+    const PieScene scene = view.exportScene(8);
+    measure(QStringLiteral("export.single"),rows,[&]{ ChartExport::render(scene,8); });
+    measure(QStringLiteral("export.tiled"),rows,[&]{ ChartExport::renderTiled(scene,8); });
+
+    //随机点命中测试，圆和彩条区域都有
+    QRandomGenerator random(1);
+    QVector<QPoint> points(4096);
+    for(QPoint &point : points)
+        point = QPoint(random.bounded(view.width()),random.bounded(view.height()));
+    int next = 0;
+    measure(QStringLiteral("indexAt"),rows,[&]{ view.indexAt(points.at(next++ & 4095)); });
+
+    //不同大小的橡皮筋矩形。两个位置交替，避免选择结果不变被跳过
+    const struct { const char *name; QSize size; } rects[] = {
+        {"setSelection.small",QSize(8,8)},
+        {"setSelection.medium",QSize(120,120)},
+        {"setSelection.large",view.size()}
+    };
+    for(const auto &rect : rects){
+        bool shift = false;
+        measure(QString::fromLatin1(rect.name),rows,[&]{
+            shift = !shift;
+            view.setSelection(QRect(QPoint(shift ? 40 : 44,shift ? 40 : 44),rect.size),QItemSelectionModel::ClearAndSelect);
+        });
+    }
+    view.selectionModel()->clear();
+
+    //选择区域：一个覆盖所有行的范围，以及最多一万个分散的单行范围
+    QItemSelection all(model.index(0,0),model.index(rows - 1,1));
+    measure(QStringLiteral("visualRegion.all"),rows,[&]{ view.visualRegionForSelection(all); });
+    QItemSelection scattered;
+    const int step = qMax(2,rows / 10000);
+    for(int row = 0; row < rows; row += step)
+        scattered.select(model.index(row,0),model.index(row,1));
+    measure(QStringLiteral("visualRegion.scattered"),rows,[&]{ view.visualRegionForSelection(scattered); });
+}
+
+//图表热点路径的基准测试：从10行到1000万行，输出每次操作的时间、堆分配次数，以及随行数的变化。
+//--json把结果写成JSON，便于长期跟踪
+int main(int argc, char *argv[])
+{
+    //视图在离屏平台上绘制，不需要显示器
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM","offscreen");
+    QApplication app(argc,argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption jsonOption(QStringLiteral("json"),QStringLiteral("Write results to a JSON file."),QStringLiteral("file"));
+    const QCommandLineOption maxRowsOption(QStringLiteral("max-rows"),QStringLiteral("Largest dataset (default 10000000)."),QStringLiteral("rows"),QStringLiteral("10000000"));
+    const QCommandLineOption minTimeOption(QStringLiteral("min-time"),QStringLiteral("Minimum milliseconds per measurement (default 200)."),QStringLiteral("ms"),QStringLiteral("200"));
+    parser.addOptions({jsonOption,maxRowsOption,minTimeOption});
+    parser.process(app);
+    const int maxRows = parser.value(maxRowsOption).toInt();
+    minTime = parser.value(minTimeOption).toLongLong();
+
+    QTemporaryDir dir;
+    if(!dir.isValid())
+        return 1;
+
+#ifndef CHARTBENCH_COUNT_MALLOC
+    std::printf("news/op counts operator new calls only; Qt containers allocate with malloc and are not included\n");
+#endif
+
+    for(int rows = 10; rows <= maxRows && rows > 0; rows *= 10){
+        const ChartData data = makeData(rows);
+        benchFiles(dir,rows,data);
+        benchView(rows,data);
+    }
+
+    if(parser.isSet(jsonOption)){
+        QJsonArray array;
+        for(const Result &result : results){
+            QJsonObject object;
+            object.insert(QStringLiteral("name"),result.name);
+            object.insert(QStringLiteral("rows"),result.rows);
+            object.insert(QStringLiteral("iterations"),result.iterations);
+            object.insert(QStringLiteral("nsPerOp"),result.nsPerOp);
+            object.insert(QLatin1String(allocationKey),result.allocsPerOp);
+            if(result.mbPerSec > 0)
+                object.insert(QStringLiteral("mbPerSec"),result.mbPerSec);
+            array.append(object);
+        }
+        QFile file(parser.value(jsonOption));
+        if(!file.open(QFile::WriteOnly)){
+            std::fprintf(stderr,"%s: %s\n",qPrintable(file.fileName()),qPrintable(file.errorString()));
+            return 1;
+        }
+        file.write(QJsonDocument(array).toJson());
+    }
+    return 0;
+}
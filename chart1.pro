@@ -1,13 +1,42 @@
-QT += widgets
+QT += widgets concurrent network
+
+# 打开PieView的调试输出
+# DEFINES += PIEVIEW_DEBUG
 
 SOURCES += \
+    chartaggregate.cpp \
+    chartexport.cpp \
+    chartfile.cpp \
+    chartlabels.cpp \
+    chartloader.cpp \
+    chartprofiler.cpp \
+    chartsaver.cpp \
+    chartselectionlink.cpp \
+    chartstream.cpp \
+    charttopmodel.cpp \
+    charttreemodel.cpp \
+    chartmodel.cpp \
     main.cpp \
     mainwindow.cpp \
-    pieview.cpp
+    pieview.cpp \
+    sunburstview.cpp
 
 HEADERS += \
+    chartaggregate.h \
+    chartexport.h \
+    chartfile.h \
+    chartlabels.h \
+    chartloader.h \
+    chartprofiler.h \
+    chartsaver.h \
+    chartselectionlink.h \
+    chartstream.h \
+    charttopmodel.h \
+    charttreemodel.h \
+    chartmodel.h \
     mainwindow.h \
-    pieview.h
+    pieview.h \
+    sunburstview.h
 
 RESOURCES += \
     chart.qrc
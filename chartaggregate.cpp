@@ -0,0 +1,311 @@
+﻿#include "chartaggregate.h"
+#include "chartmodel.h"
+#include <algorithm>
+
+//同一模型、根项和列的汇总只有一份。只在界面线程使用
+static QVector<QWeakPointer<ChartAggregate>> &registry()
+{
+    static QVector<QWeakPointer<ChartAggregate>> aggregates;
+    return aggregates;
+}
+
+QSharedPointer<ChartAggregate> ChartAggregate::instance(QAbstractItemModel *model, const QModelIndex &root, int column)
+{
+    if(!model)
+        return QSharedPointer<ChartAggregate>(new ChartAggregate(nullptr,QModelIndex(),column));
+
+    //视图一般只有几个，顺序查找就够了。顺便去掉已经释放的
+    QVector<QWeakPointer<ChartAggregate>> &aggregates = registry();
+    for(int i = aggregates.size() - 1; i >= 0; --i){
+        QSharedPointer<ChartAggregate> aggregate = aggregates.at(i).toStrongRef();
+        if(!aggregate){
+            aggregates.remove(i);
+            continue;
+        }
+        if(aggregate->itemModel == model && aggregate->root == root && aggregate->valueColumn == column)
+            return aggregate;
+    }
+    QSharedPointer<ChartAggregate> aggregate(new ChartAggregate(model,root,column));
+    aggregates.append(aggregate);
+    return aggregate;
+}
+
+ChartAggregate::ChartAggregate(QAbstractItemModel *model, const QModelIndex &root, int column)
+    :itemModel(model),root(root),valueColumn(column)
+{
+    if(model){
+        chartModel = qobject_cast<ChartModel *>(model);
+        connect(model,&QAbstractItemModel::dataChanged,this,&ChartAggregate::dataChanged);
+        connect(model,&QAbstractItemModel::rowsInserted,this,&ChartAggregate::rowsInserted);
+        connect(model,&QAbstractItemModel::rowsRemoved,this,&ChartAggregate::rowsRemoved);
+        connect(model,&QAbstractItemModel::rowsMoved,this,&ChartAggregate::invalidate);
+        connect(model,&QAbstractItemModel::layoutChanged,this,&ChartAggregate::invalidate);
+        connect(model,&QAbstractItemModel::modelReset,this,&ChartAggregate::invalidate);
+        connect(model,&QObject::destroyed,this,&ChartAggregate::modelDestroyed);
+    }
+    recompute();
+}
+
+int ChartAggregate::rowCount() const
+{
+    return modelRows;
+}
+
+int ChartAggregate::validItems() const
+{
+    return validCount;
+}
+
+double ChartAggregate::totalValue() const
+{
+    return total;
+}
+
+double ChartAggregate::rowValue(int row) const
+{
+    return row >= 0 && row < rowValues.size() ? rowValues.at(row) : 0.0;
+}
+
+const QVector<int> &ChartAggregate::sliceRows() const
+{
+    updateSliceIndex();
+    return slices;
+}
+
+const QVector<double> &ChartAggregate::sliceEnds() const
+{
+    updateSliceIndex();
+    return ends;
+}
+
+//二分查找角度所在的扇区。扇区i覆盖[ends[i-1],ends[i])的累计数值
+int ChartAggregate::sliceAt(double angle) const
+{
+    updateSliceIndex();
+    if(ends.isEmpty())
+        return -1;
+    //把角度换算成累计数值，用索引自己的总和，避免与total的舍入误差
+    const double target = angle / 360.0 * ends.last();
+    auto it = std::upper_bound(ends.constBegin(),ends.constEnd(),target);
+    if(it == ends.constEnd())
+        return -1;
+    return int(it - ends.constBegin());
+}
+
+int ChartAggregate::slotForRow(int row) const
+{
+    updateSliceIndex();
+    if(row < 0 || row >= rowSlots.size())
+        return -1;
+    return rowSlots.at(row);
+}
+
+int ChartAggregate::rowForSlot(int slot) const
+{
+    updateSliceIndex();
+    if(slot < 0 || slot >= slices.size())
+        return -1;
+    return slices.at(slot);
+}
+
+void ChartAggregate::update() const
+{
+    if(pendingScheduled)
+        const_cast<ChartAggregate *>(this)->apply();
+}
+
+//只关心根项下数值列的变化，多次通知合并成一个行范围
+void ChartAggregate::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if(!roles.isEmpty() && !roles.contains(Qt::DisplayRole))
+        return;
+    if(topLeft.parent() != root || topLeft.column() > valueColumn || bottomRight.column() < valueColumn)
+        return;
+    dirtyFirst = qMin(dirtyFirst,qMax(topLeft.row(),0));
+    dirtyLast = qMax(dirtyLast,bottomRight.row());
+    schedule();
+}
+
+//追加在末尾的行只记下起点，插在中间时整体重算
+void ChartAggregate::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    if(parent != root)
+        return;
+    if(start == modelRows && !recomputeNeeded){
+        if(appendedFrom < 0)
+            appendedFrom = start;
+    }else{
+        recomputeNeeded = true;
+    }
+    modelRows += end - start + 1;
+    schedule();
+}
+
+//删除后行号移动了，整体重算
+void ChartAggregate::rowsRemoved(const QModelIndex &parent, int start, int end)
+{
+    if(parent != root)
+        return;
+    recomputeNeeded = true;
+    modelRows -= end - start + 1;
+    schedule();
+}
+
+void ChartAggregate::invalidate()
+{
+    recomputeNeeded = true;
+    schedule();
+}
+
+//视图会随后换成空模型，这里只清空，不发出changed
+void ChartAggregate::modelDestroyed()
+{
+    recompute(); //itemModel已经为空，行数为0，推迟的通知一并清除
+}
+
+void ChartAggregate::schedule()
+{
+    if(pendingScheduled)
+        return;
+    pendingScheduled = true;
+    QMetaObject::invokeMethod(this,[this]{ apply(); },Qt::QueuedConnection);
+}
+
+//先修正变化范围内的数值，再读取末尾追加的行。不管之前来了多少个通知，总值和扇区索引都只算一次
+void ChartAggregate::apply()
+{
+    if(!pendingScheduled)
+        return;
+    pendingScheduled = false;
+
+    //模型在排队期间被销毁
+    if(!itemModel){
+        recompute();
+        emit changed(true);
+        return;
+    }
+
+    if(recomputeNeeded){
+        recompute();
+        emit changed(true);
+        return;
+    }
+
+    bool rebuild = false; //有效行变了，扇区索引要重建
+    int patchFrom = INT_MAX; //有效行不变时从这一行开始修正累计值
+
+    const int first = dirtyFirst;
+    const int last = qMin(dirtyLast,rowValues.size() - 1); //追加的行下面单独读取
+    for(int row = first; row <= last; ++row){
+        const double oldValue = rowValues.at(row);
+        const double value = readValue(row);
+        if(value == oldValue)
+            continue;
+        patchFrom = qMin(patchFrom,row);
+        rowValues[row] = value;
+        if(oldValue > 0.0){
+            total -= oldValue;
+            --validCount;
+        }
+        if(value > 0.0){
+            total += value;
+            ++validCount;
+        }
+        if((oldValue > 0.0) != (value > 0.0))
+            rebuild = true;
+    }
+    dirtyFirst = INT_MAX;
+    dirtyLast = -1;
+
+    if(appendedFrom >= 0){
+        rowValues.reserve(modelRows);
+        for(int row = appendedFrom; row < modelRows; ++row){
+            const double value = readValue(row);
+            rowValues.append(value);
+            if(value > 0.0){
+                total += value;
+                ++validCount;
+            }
+        }
+        appendedFrom = -1;
+        rebuild = true;
+    }
+
+    if(rebuild)
+        sliceIndexDirty = true;
+    else if(patchFrom != INT_MAX)
+        patchSliceIndex(patchFrom);
+    else
+        return; //数值都没变
+    emit changed(false);
+}
+
+void ChartAggregate::recompute()
+{
+    const int rowCount = itemModel ? itemModel->rowCount(root) : 0;
+    //推迟的通知都包含在这次重算中
+    modelRows = rowCount;
+    dirtyFirst = INT_MAX;
+    dirtyLast = -1;
+    appendedFrom = -1;
+    recomputeNeeded = false;
+    pendingScheduled = false;
+    validCount = 0;
+    total = 0.0;
+    rowValues.resize(rowCount);
+    for(int row = 0; row < rowCount; ++row){
+        const double value = readValue(row);
+        rowValues[row] = value;
+        if(value > 0.0){
+            total += value;
+            ++validCount;
+        }
+    }
+    sliceIndexDirty = true;
+}
+
+double ChartAggregate::readValue(int row) const
+{
+    if(!itemModel)
+        return 0.0;
+    //ChartModel的行都在根项下，直接读数值数组
+    if(chartModel && !root.isValid() && valueColumn == 1)
+        return chartModel->values()[size_t(row)];
+    return itemModel->data(itemModel->index(row,valueColumn,root),Qt::DisplayRole).toDouble();
+}
+
+//只有数据改变后才会重建，直接用缓存的行数值，不访问模型
+void ChartAggregate::updateSliceIndex() const
+{
+    if(!sliceIndexDirty)
+        return;
+
+    slices.clear();
+    ends.clear();
+    double sum = 0.0;
+    const int rowCount = rowValues.size();
+    rowSlots.fill(-1,rowCount);
+    for(int row = 0; row < rowCount; ++row){
+        const double value = rowValues.at(row);
+        if(value > 0.0){
+            sum += value;
+            rowSlots[row] = slices.size();
+            slices.append(row);
+            ends.append(sum);
+        }
+    }
+    sliceIndexDirty = false;
+}
+
+void ChartAggregate::patchSliceIndex(int firstRow)
+{
+    if(sliceIndexDirty)
+        return; //下次使用时会整体重建
+    //slices按行号递增，二分找到firstRow及之后的第一个有效扇区
+    int slot = int(std::lower_bound(slices.constBegin(),slices.constEnd(),firstRow) - slices.constBegin());
+    double sum = slot > 0 ? ends.at(slot - 1) : 0.0;
+    for(; slot < slices.size(); ++slot){
+        sum += rowValues.at(slices.at(slot));
+        ends[slot] = sum;
+    }
+}
@@ -0,0 +1,109 @@
+﻿#ifndef CHARTAGGREGATE_H
+#define CHARTAGGREGATE_H
+
+#include <QObject>
+#include <QPersistentModelIndex>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QVector>
+#include <climits>
+
+QT_BEGIN_NAMESPACE
+class QAbstractItemModel;
+QT_END_NAMESPACE
+class ChartModel;
+
+//模型中一个父项下各行数值的汇总：每行数值、有效行数、总值和扇区角度索引。
+//按模型、根项和数值列共享，同一模型上的多个视图只有一份：模型信号只连接一次，每次变化只算一次。
+//模型通知先记下范围，下一轮事件循环中一次处理，处理完发出changed。
+//查询只读最近一次处理的结果，不会在查询中处理通知、发出信号，绘制时可以放心调用；
+//不经过事件循环就要最新结果时(离屏绘制、导出)先调用update()
+class ChartAggregate : public QObject
+{
+    Q_OBJECT
+
+public:
+    //取得共享的汇总。模型、根项和列都相同时返回同一个对象，最后一个使用者释放后销毁。
+    //model为空时返回一个空的汇总
+    static QSharedPointer<ChartAggregate> instance(QAbstractItemModel *model, const QModelIndex &root, int column = 1);
+
+    QAbstractItemModel *model() const { return itemModel; }
+    QModelIndex rootIndex() const { return root; }
+    int column() const { return valueColumn; }
+
+    //以下查询都是最近一次处理后的结果。还有推迟的通知时，行号可能已经超出模型
+    //根项下的行数
+    int rowCount() const;
+    //数值大于0的行数
+    int validItems() const;
+    double totalValue() const;
+    //缓存的一行数值
+    double rowValue(int row) const;
+
+    //扇区角度索引。sliceRows为第i个有效扇区对应的模型行，sliceEnds为到第i个扇区为止的累计数值。
+    //角度 = 360 * 累计数值 / 总数值
+    const QVector<int> &sliceRows() const;
+    const QVector<double> &sliceEnds() const;
+    //二分查找角度所在的扇区，返回有效扇区序号，找不到返回-1
+    int sliceAt(double angle) const;
+    //行号与有效扇区序号的互相转换，O(1)
+    int slotForRow(int row) const;
+    int rowForSlot(int slot) const;
+
+    //立即处理推迟的模型通知，有变化时发出changed。不要在绘制中调用
+    void update() const;
+
+signals:
+    //汇总变了。rowsRenumbered为true时行号可能都变了(重置、删除、插在中间或重排)，视图按行的缓存要清空
+    void changed(bool rowsRenumbered);
+
+private:
+    ChartAggregate(QAbstractItemModel *model, const QModelIndex &root, int column);
+
+    //模型通知，只记下范围
+    void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void rowsInserted(const QModelIndex &parent, int start, int end);
+    void rowsRemoved(const QModelIndex &parent, int start, int end);
+    //重置、布局变化或行移动，全部重算
+    void invalidate();
+    //模型被销毁：清空汇总，丢弃推迟的通知
+    void modelDestroyed();
+
+    //安排在下一轮事件循环中处理推迟的模型通知
+    void schedule();
+    //一次处理推迟的模型通知
+    void apply();
+    //全部重算每行数值、总值和有效行数
+    void recompute();
+    //从模型读取一行的数值
+    double readValue(int row) const;
+    //按需重建扇区角度索引
+    void updateSliceIndex() const;
+    //有效行不变、只有数值变化时，从firstRow开始修正累计值
+    void patchSliceIndex(int firstRow);
+
+    QPointer<QAbstractItemModel> itemModel;
+    QPersistentModelIndex root;
+    int valueColumn = 1;
+    //模型是ChartModel、根项为空、数值在第1列时直接读取它的数值数组，不经过QVariant
+    QPointer<const ChartModel> chartModel;
+
+    QVector<double> rowValues; //每行数值的缓存，数值大于0的行才是有效行
+    int validCount = 0;
+    double total = 0.0;
+
+    //推迟处理的模型通知
+    int modelRows = 0; //已收到通知的模型行数，包括还没读取的追加行
+    int dirtyFirst = INT_MAX; //数值可能变化的行范围
+    int dirtyLast = -1;
+    int appendedFrom = -1; //从这一行起是末尾追加、还没读取的行
+    bool recomputeNeeded = false; //有行被删除或插在中间，全部重算
+    bool pendingScheduled = false; //有推迟的通知等待处理
+
+    mutable QVector<int> slices; //扇区角度索引，见sliceRows
+    mutable QVector<double> ends;
+    mutable QVector<int> rowSlots; //模型行对应的有效扇区序号，数值不大于0的行为-1
+    mutable bool sliceIndexDirty = true;
+};
+
+#endif // CHARTAGGREGATE_H
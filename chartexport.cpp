@@ -0,0 +1,166 @@
+﻿#include "chartexport.h"
+#include <QFileInfo>
+#include <QPainter>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QtMath>
+#include <deque>
+
+QSize ChartExport::imageSize(const PieScene &scene, qreal scale)
+{
+    return QSize(qCeil(scene.area.width() * scale),qCeil(scene.area.height() * scale));
+}
+
+//先平移整像素再放大，每块的变换只差一个整数平移，光栅化的结果与整张图中对应的像素相同
+void ChartExport::renderTile(const PieScene &scene, qreal scale, QImage *image, const QPoint &origin)
+{
+    image->fill(QColor(scene.background));
+
+    //这一块在内容坐标中的范围，多算一个像素给抗锯齿和画笔
+    const QRectF target(QPointF(origin) / scale + QPointF(scene.area.topLeft()),QSizeF(image->size()) / scale);
+    const QRect visible = target.toAlignedRect().adjusted(-1,-1,1,1);
+
+    QPainter painter(image);
+    painter.setRenderHint(QPainter::Antialiasing); //抗锯齿
+    painter.translate(-origin);
+    painter.scale(scale,scale);
+    painter.translate(-scene.area.topLeft());
+
+    //圆和扇区，与PieView::paintPie的画法相同
+    const QRect pieRect(scene.margin,scene.margin,scene.pieSize,scene.pieSize);
+    if(!scene.wedges.isEmpty() && visible.intersects(pieRect.adjusted(-1,-1,1,1))){
+        painter.save();
+        painter.setPen(QColor(scene.foreground));
+        painter.translate(pieRect.topLeft());
+        painter.drawEllipse(0,0,scene.pieSize,scene.pieSize);
+        for(const PieScene::Wedge &wedge : scene.wedges){
+            if(!wedge.bounds.intersects(visible))
+                continue;
+            painter.setBrush(QColor(wedge.color));
+            painter.drawPie(0,0,scene.pieSize,scene.pieSize,wedge.start,wedge.span);
+        }
+        painter.restore();
+    }
+
+    //彩条。字体每块各建一个，不与其他线程共享
+    if(scene.legend.isEmpty())
+        return;
+    QFont font;
+    font.fromString(scene.font);
+    painter.setFont(font);
+    painter.setPen(QColor(scene.textColor));
+    for(const PieScene::LegendItem &item : scene.legend){
+        if(!item.rect.intersects(visible))
+            continue;
+        painter.fillRect(item.swatch,QColor(item.color));
+        painter.drawText(item.baseline,item.text);
+    }
+}
+
+QImage ChartExport::render(const PieScene &scene, qreal scale)
+{
+    QImage image(imageSize(scene,scale),QImage::Format_ARGB32_Premultiplied);
+    if(!image.isNull())
+        renderTile(scene,scale,&image,QPoint(0,0));
+    return image;
+}
+
+QImage ChartExport::renderTiled(const PieScene &scene, qreal scale, int bandRows)
+{
+    const QSize size = imageSize(scene,scale);
+    QImage image(size,QImage::Format_ARGB32_Premultiplied);
+    if(image.isNull()) //太大，分配失败
+        return image;
+
+    //每条是整张图中连续的几行，直接在原来的内存上画
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+    bandRows = qMax(1,bandRows);
+    QVector<int> tops;
+    for(int top = 0; top < size.height(); top += bandRows)
+        tops.append(top);
+    QtConcurrent::blockingMap(tops,[&](int top){
+        QImage band(bits + qsizetype(top) * bytesPerLine,size.width(),qMin(bandRows,size.height() - top),bytesPerLine,QImage::Format_ARGB32_Premultiplied);
+        renderTile(scene,scale,&band,QPoint(0,top));
+    });
+    return image;
+}
+
+bool ChartExport::write(const PieScene &scene, qreal scale, const QString &fileName, QString *error, int bandRows)
+{
+    const QSize size = imageSize(scene,scale);
+    if(size.isEmpty()){
+        if(error)
+            *error = QStringLiteral("图片大小为0");
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if(suffix != QLatin1String("ppm")){
+        //整张画好再保存，内存要放下整张图。太大时不去分配，几十GB的图会拖垮整个系统
+        const qint64 bytes = qint64(size.width()) * size.height() * 4;
+        if(bytes > maxImageBytes){
+            if(error)
+                *error = QStringLiteral("图片太大(%1x%2，需要%3 MB内存，上限%4 MB)，请导出为.ppm格式，按横条写出")
+                        .arg(size.width()).arg(size.height()).arg(bytes >> 20).arg(maxImageBytes >> 20);
+            return false;
+        }
+        const QImage image = renderTiled(scene,scale,bandRows);
+        if(image.isNull()){
+            if(error)
+                *error = QStringLiteral("图片太大，内存不足");
+            return false;
+        }
+        if(!file.open(QIODevice::WriteOnly) || !image.save(&file,suffix.toLatin1().constData()) || !file.commit()){
+            if(error)
+                *error = file.error() != QFileDevice::NoError ? file.errorString() : QStringLiteral("不支持的图片格式");
+            return false;
+        }
+        return true;
+    }
+
+    //ppm：文件头之后按行存放RGB，可以一条一条按顺序写出
+    if(!file.open(QIODevice::WriteOnly)){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    const QByteArray header = QByteArray("P6\n") + QByteArray::number(size.width()) + ' ' + QByteArray::number(size.height()) + "\n255\n";
+    if(file.write(header) != header.size()){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+
+    //正在画的横条不超过线程数的两倍。先画好的等前面的写完，写出后立即释放
+    bandRows = qMax(1,bandRows);
+    const int window = 2 * qMax(1,QThreadPool::globalInstance()->maxThreadCount());
+    std::deque<QFuture<QImage>> running;
+    bool ok = true;
+    int top = 0;
+    while((ok && top < size.height()) || !running.empty()){
+        while(ok && top < size.height() && int(running.size()) < window){
+            const int rows = qMin(bandRows,size.height() - top);
+            running.push_back(QtConcurrent::run([&scene,scale,size,top,rows]{
+                QImage band(size.width(),rows,QImage::Format_RGB32);
+                renderTile(scene,scale,&band,QPoint(0,top));
+                return band.convertToFormat(QImage::Format_RGB888);
+            }));
+            top += rows;
+        }
+        //写入失败后不再开始新的横条，也不再写，但要等已经开始的横条画完，它们引用着scene
+        const QImage band = running.front().result();
+        running.pop_front();
+        const qint64 lineBytes = qint64(band.width()) * 3;
+        for(int y = 0; ok && y < band.height(); ++y)
+            ok = file.write(reinterpret_cast<const char *>(band.constScanLine(y)),lineBytes) == lineBytes;
+    }
+    if(!ok || !file.commit()){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+﻿#ifndef CHARTEXPORT_H
+#define CHARTEXPORT_H
+
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+//圆和彩条的一份快照。在界面线程由PieView::exportScene取得，之后只读，可以同时在多个线程中画。
+//坐标都是视图的内容坐标(逻辑像素)
+struct PieScene
+{
+    QRect area; //要导出的内容区域，一般是当前视口看到的部分
+    int margin = 0;
+    int pieSize = 0; //圆的直径，左上角在(margin,margin)
+    QRgb background = 0;
+    QRgb foreground = 0; //圆和扇区的边线
+    QRgb textColor = 0;
+    //字体描述(QFont::toString)。QFont内部的字体引擎缓存不能跨线程共享，每个线程各自建一个
+    QString font;
+
+    //一块扇区，细小的相邻扇区已按导出的分辨率合成一块
+    struct Wedge
+    {
+        int start; //单位为1/16度，与drawPie一致
+        int span;
+        QRgb color;
+        QRect bounds; //外接矩形，分块时跳过不相交的扇区
+    };
+    QVector<Wedge> wedges;
+
+    //一个彩条：颜色块和省略好的文字
+    struct LegendItem
+    {
+        QRect rect;
+        QRect swatch;
+        QPointF baseline; //文字基线的起点
+        QRgb color;
+        QString text;
+    };
+    QVector<LegendItem> legend; //只有与area相交的彩条
+};
+
+//把快照画成大图。图按固定行数分成横条，在全局线程池中并行光栅化，每条只画与它相交的扇区和彩条。
+//各条的原点都在整像素上，画出的像素与整张图一次画完完全相同
+class ChartExport
+{
+public:
+    //输出图的大小：area按scale放大后向上取整
+    static QSize imageSize(const PieScene &scene, qreal scale);
+
+    //画输出图的一块：image的左上角对应输出图中的origin，只画与这一块相交的扇区和彩条
+    static void renderTile(const PieScene &scene, qreal scale, QImage *image, const QPoint &origin);
+    //单线程，一次画完整张图
+    static QImage render(const PieScene &scene, qreal scale);
+    //多线程，各横条直接画进同一张图的对应行，不另外分配内存
+    static QImage renderTiled(const PieScene &scene, qreal scale, int bandRows = 256);
+
+    //非ppm格式整张图在内存中的上限，字节
+    static const qint64 maxImageBytes = qint64(1) << 30;
+
+    //导出到文件。扩展名为ppm时按顺序逐条写出，内存中最多只有线程数两倍的横条，再大的图也不用整张放下；
+    //其他格式的编码器要整张图，画好后由QImage保存，超过maxImageBytes时不画，返回错误并建议改用ppm。
+    //写到临时文件，成功后才替换目标文件
+    static bool write(const PieScene &scene, qreal scale, const QString &fileName, QString *error = nullptr, int bandRows = 256);
+};
+
+#endif // CHARTEXPORT_H
@@ -0,0 +1,9 @@
+QT -= gui
+QT += network
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = chartfeed
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,76 @@
+﻿#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QRandomGenerator>
+#include <QThread>
+#include <cstdio>
+
+//实时数据流的测试发送端：连接到图表程序的本地套接字，按指定速率发送"标签,数值[,颜色]"更新。
+//用于对数据流模式做压力测试
+//用法：chartfeed [--server chart1] [--rate 50000] [--labels 1000] [--seconds 10]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc,argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption serverOption(QStringLiteral("server"),QStringLiteral("Server name (default chart1)."),QStringLiteral("name"),QStringLiteral("chart1"));
+    const QCommandLineOption rateOption(QStringLiteral("rate"),QStringLiteral("Updates per second (default 50000)."),QStringLiteral("n"),QStringLiteral("50000"));
+    const QCommandLineOption labelsOption(QStringLiteral("labels"),QStringLiteral("Distinct labels (default 1000)."),QStringLiteral("n"),QStringLiteral("1000"));
+    const QCommandLineOption secondsOption(QStringLiteral("seconds"),QStringLiteral("Run time, 0 for unlimited (default 10)."),QStringLiteral("s"),QStringLiteral("10"));
+    parser.addOptions({serverOption,rateOption,labelsOption,secondsOption});
+    parser.process(app);
+
+    const int rate = qMax(1,parser.value(rateOption).toInt());
+    const int labels = qMax(1,parser.value(labelsOption).toInt());
+    const qint64 duration = parser.value(secondsOption).toLongLong() * 1000;
+
+    QLocalSocket socket;
+    socket.connectToServer(parser.value(serverOption));
+    if(!socket.waitForConnected(3000)){
+        std::fprintf(stderr,"%s: %s\n",qPrintable(parser.value(serverOption)),qPrintable(socket.errorString()));
+        return 1;
+    }
+
+    //每10毫秒发送一批。每个标签第一次出现时带上颜色，之后只发数值
+    QRandomGenerator random(1);
+    QVector<double> values(labels,100.0);
+    QVector<bool> sent(labels,false);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 total = 0;
+    QByteArray batch;
+    while(duration == 0 || timer.elapsed() < duration){
+        const qint64 due = rate * timer.elapsed() / 1000 - total; //按速率到现在应该发送的条数
+        batch.clear();
+        for(qint64 i = 0; i < due; ++i){
+            const int label = random.bounded(labels);
+            values[label] = qMax(1.0,values[label] + random.bounded(21) - 10); //随机游走
+            batch += "Category " + QByteArray::number(label) + ',' + QByteArray::number(values[label],'f',1);
+            if(!sent[label]){
+                batch += ",#" + QByteArray::number(0x100000 + random.bounded(0xefffff),16);
+                sent[label] = true;
+            }
+            batch += '\n';
+        }
+        total += due;
+        if(!batch.isEmpty()){
+            socket.write(batch);
+            //接收端跟不上时在这里等待，发送端的缓冲区不会无限增长
+            while(socket.bytesToWrite() > (1 << 20) && socket.waitForBytesWritten(1000)){}
+            if(socket.state() != QLocalSocket::ConnectedState){
+                std::fprintf(stderr,"disconnected after %lld updates\n",total);
+                return 1;
+            }
+        }
+        socket.flush();
+        QThread::msleep(10);
+    }
+    socket.waitForBytesWritten(3000);
+    socket.disconnectFromServer();
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    std::printf("%lld updates, %.1f s, %.0f updates/s\n",total,seconds,total / seconds);
+    return 0;
+}
@@ -0,0 +1,641 @@
+﻿#include "chartfile.h"
+#include <QFile>
+#include <QVarLengthArray>
+#include <QLocale>
+#include <QSaveFile>
+#include <QTextCodec>
+#include <QThread>
+#include <QtEndian>
+#include <QtConcurrentMap>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+//x86上用SSE2一次比较16个字节
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHARTFILE_SSE2
+#endif
+
+//检查一段字节是否为合法的UTF-8。ASCII字节直接跳过
+static bool isUtf8(const char *begin, const char *end)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(begin);
+    const unsigned char *e = reinterpret_cast<const unsigned char *>(end);
+    while(p < e){
+        const unsigned char c = *p;
+        if(c < 0x80){
+            ++p;
+            continue;
+        }
+        int n; //后续字节数
+        if((c & 0xE0) == 0xC0 && c >= 0xC2)
+            n = 1;
+        else if((c & 0xF0) == 0xE0)
+            n = 2;
+        else if((c & 0xF8) == 0xF0 && c <= 0xF4)
+            n = 3;
+        else
+            return false;
+        if(e - p <= n)
+            return false;
+        for(int i = 1; i <= n; ++i){
+            if((p[i] & 0xC0) != 0x80)
+                return false;
+        }
+        p += n + 1;
+    }
+    return true;
+}
+
+//找到下一个逗号或换行符，没有时返回end
+static const char *findDelimiter(const char *p, const char *end)
+{
+#ifdef CHARTFILE_SSE2
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while(end - p >= 16){
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes,comma),_mm_cmpeq_epi8(bytes,newline)));
+        if(mask)
+            return p + qCountTrailingZeroBits(quint32(mask));
+        p += 16;
+    }
+#endif
+    while(p < end && *p != ',' && *p != '\n')
+        ++p;
+    return p;
+}
+
+//是否全是ASCII字节。是的话标签不用经过编码转换
+static bool isAscii(const char *begin, const char *end)
+{
+    unsigned char bits = 0;
+    for(const char *p = begin; p < end; ++p)
+        bits |= static_cast<unsigned char>(*p);
+    return bits < 0x80;
+}
+
+//解析数值。常见的"123"、"-4.5"直接在这里算出，指数形式等少见的写法交给QByteArray::toDouble
+static bool parseNumber(const char *begin, const char *end, double *value)
+{
+    //15位以内的整数和10的22次方以内都能被double精确表示，一次除法的结果就是正确舍入的
+    static const double powersOf10[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                                        1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    const char *p = begin;
+    const char *e = end;
+    while(p < e && (*p == ' ' || *p == '\t'))
+        ++p;
+    while(e > p && (e[-1] == ' ' || e[-1] == '\t'))
+        --e;
+
+    bool negative = false;
+    if(p < e && (*p == '-' || *p == '+')){
+        negative = *p == '-';
+        ++p;
+    }
+    quint64 mantissa = 0;
+    int digits = 0; //有效数字个数
+    int fraction = 0; //小数位数
+    while(p < e && unsigned(*p - '0') < 10){
+        mantissa = mantissa * 10 + unsigned(*p - '0');
+        ++digits;
+        ++p;
+    }
+    if(p < e && *p == '.'){
+        ++p;
+        while(p < e && unsigned(*p - '0') < 10){
+            mantissa = mantissa * 10 + unsigned(*p - '0');
+            ++digits;
+            ++fraction;
+            ++p;
+        }
+    }
+    if(p == e && digits > 0 && digits <= 15 && fraction <= 22){
+        const double number = double(mantissa) / powersOf10[fraction];
+        *value = negative ? -number : number;
+        return true;
+    }
+
+    bool ok = false;
+    *value = QByteArray::fromRawData(begin,int(end - begin)).toDouble(&ok);
+    return ok;
+}
+
+//十六进制数字的值，不是十六进制数字返回-1
+static int hexDigit(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20; //转成小写
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+//解析颜色名。"#rrggbb"直接按十六进制解码，其他写法(如颜色名称)交给QColor
+static bool parseColor(const char *begin, const char *end, QRgb *rgb)
+{
+    if(end - begin == 7 && *begin == '#'){
+        QRgb value = 0;
+        bool ok = true;
+        for(int i = 1; i < 7 && ok; ++i){
+            const int digit = hexDigit(begin[i]);
+            ok = digit >= 0;
+            value = (value << 4) | QRgb(digit);
+        }
+        if(ok){
+            *rgb = 0xff000000u | value;
+            return true;
+        }
+    }
+
+    QColor color;
+    color.setNamedColor(QString::fromLatin1(begin,int(end - begin)));
+    if(!color.isValid())
+        return false;
+    *rgb = color.rgb();
+    return true;
+}
+
+//根据文件开头判断标签的编码
+QTextCodec *ChartFile::detectCodec(const char **begin, const char *end)
+{
+    //带BOM的UTF-8，跳过BOM
+    if(end - *begin >= 3 && std::memcmp(*begin,"\xEF\xBB\xBF",3) == 0){
+        *begin += 3;
+        return nullptr;
+    }
+    if(isUtf8(*begin,end))
+        return nullptr;
+
+    //不是UTF-8时按本地编码读取，与QTextStream的默认行为相同。本地编码本身是UTF-8时按GBK的超集GB18030读取
+    QTextCodec *codec = QTextCodec::codecForLocale();
+    if(codec->mibEnum() == 106) //106为UTF-8
+        codec = QTextCodec::codecForName("GB18030");
+    return codec;
+}
+
+//解析内存中的一段文本。每行用逗号拆分，空字段跳过，前三个字段为标签、数值、颜色
+void ChartFile::parse(const char *begin, const char *end, QTextCodec *codec, ChartData *data, ChartLoadStats *stats)
+{
+    //先数一下行数，一次预留好空间
+    int lines = 0;
+    for(const char *p = begin; (p = static_cast<const char *>(std::memchr(p,'\n',size_t(end - p)))); ++p)
+        ++lines;
+    data->reserve(data->size() + lines + 1);
+
+    QVarLengthArray<QChar,256> ascii; //纯ASCII标签扩展成UTF-16的缓冲区，只用来在字典中查找
+    const char *p = begin;
+    while(p < end){
+        ++stats->lines;
+
+        //一次扫描同时找逗号和换行，拆分出前三个非空字段
+        const char *fields[3][2];
+        int count = 0;
+        bool empty = true; //去掉\r后是否为空行
+        const char *eol = end;
+        const char *field = p;
+        while(field < end){
+            const char *delimiter = count < 3 ? findDelimiter(field,end)
+                                              : static_cast<const char *>(std::memchr(field,'\n',size_t(end - field)));
+            if(!delimiter)
+                delimiter = end;
+            const bool lineEnd = delimiter == end || *delimiter == '\n';
+            const char *fieldEnd = delimiter;
+            if(lineEnd && fieldEnd > field && fieldEnd[-1] == '\r')
+                --fieldEnd;
+            if(fieldEnd > field || !lineEnd)
+                empty = false;
+            if(fieldEnd > field && count < 3){
+                fields[count][0] = field;
+                fields[count][1] = fieldEnd;
+                ++count;
+            }
+            if(lineEnd){
+                eol = delimiter;
+                break;
+            }
+            field = delimiter + 1;
+        }
+
+        if(!empty){ //空行不算错误
+            bool ok = count == 3;
+            double value = 0.0;
+            QRgb rgb = 0;
+            if(ok)
+                ok = parseNumber(fields[1][0],fields[1][1],&value);
+            if(ok)
+                ok = parseColor(fields[2][0],fields[2][1],&rgb);
+
+            if(ok){
+                const char *label = fields[0][0];
+                const int length = int(fields[0][1] - label);
+                //标签的编码按整个文件判断一次；纯ASCII的标签直接扩展到缓冲区，已在字典中的标签不分配内存
+                if(isAscii(label,fields[0][1])){
+                    ascii.resize(length);
+                    for(int i = 0; i < length; ++i)
+                        ascii[i] = QLatin1Char(label[i]);
+                    data->append(QStringView(ascii.constData(),length),value,rgb);
+                }else{
+                    data->append(codec ? codec->toUnicode(label,length) : QString::fromUtf8(label,length),value,rgb);
+                }
+                ++stats->rows;
+            }else{
+                if(stats->malformedLines == 0)
+                    stats->firstMalformedLine = stats->lines;
+                ++stats->malformedLines;
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+//把文本按换行符对齐分成几块，在线程池中同时解析，再按顺序合并
+void ChartFile::parseParallel(const char *begin, const char *end, QTextCodec *codec, ChartData *data, ChartLoadStats *stats, int threads)
+{
+    if(threads <= 0)
+        threads = QThread::idealThreadCount();
+    //每块至少1MB，小文件直接在当前线程解析
+    const qint64 size = end - begin;
+    const int chunks = int(qMin<qint64>(threads,size / (1 << 20)));
+    if(chunks <= 1){
+        parse(begin,end,codec,data,stats);
+        return;
+    }
+
+    struct Chunk
+    {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+        ChartData data;
+        ChartLoadStats stats; //行号从这一块的第一行算起
+    };
+    std::vector<Chunk> parts(static_cast<size_t>(chunks));
+    const char *p = begin;
+    for(int i = 0; i < chunks; ++i){
+        const char *chunkEnd = i == chunks - 1 ? end : qMax(p,begin + size * (i + 1) / chunks);
+        //分界点移到下一个换行符之后，保证每块都是整行
+        if(chunkEnd < end){
+            const char *newline = static_cast<const char *>(std::memchr(chunkEnd,'\n',size_t(end - chunkEnd)));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        parts[size_t(i)].begin = p;
+        parts[size_t(i)].end = chunkEnd;
+        p = chunkEnd;
+    }
+
+    QtConcurrent::blockingMap(parts,[codec](Chunk &chunk){
+        parse(chunk.begin,chunk.end,codec,&chunk.data,&chunk.stats);
+    });
+
+    //按顺序合并，把每块的行号换算成整个文件的行号
+    int rows = 0;
+    for(const Chunk &chunk : parts)
+        rows += chunk.data.size();
+    data->reserve(data->size() + rows);
+    for(const Chunk &chunk : parts){
+        if(chunk.stats.malformedLines > 0 && stats->malformedLines == 0)
+            stats->firstMalformedLine = stats->lines + chunk.stats.firstMalformedLine;
+        stats->malformedLines += chunk.stats.malformedLines;
+        stats->rows += chunk.stats.rows;
+        stats->lines += chunk.stats.lines;
+        data->append(chunk.data); //各块的字典合并进来，每个不同的标签只换算一次
+    }
+}
+
+//把整个文件映射到内存后读取。二进制文件直接复制各列，文本文件并行解析
+bool ChartFile::read(const QString &fileName, ChartData *data, ChartLoadStats *stats, QString *error)
+{
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly)){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+
+    QByteArray buffer;
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    if(file.size() > 0){
+        //映射失败时(如压缩过的资源文件)一次读入
+        if(uchar *mapped = file.map(0,file.size())){
+            begin = reinterpret_cast<const char *>(mapped);
+            end = begin + file.size();
+        }else{
+            buffer = file.readAll();
+            begin = buffer.constData();
+            end = begin + buffer.size();
+        }
+    }
+    if(begin == end)
+        return true;
+
+    if(isBinary(begin,end)){
+        ChartBinaryHeader header;
+        if(!binaryHeader(begin,end,&header,error))
+            return false;
+        QVector<quint32> ids;
+        const ChartLabels labels = binaryLabels(begin,header,&ids);
+        readBinaryRows(begin,header,labels,ids,0,int(header.rows),data);
+        stats->lines += int(header.rows);
+        stats->rows += int(header.rows);
+        return true;
+    }
+
+    QTextCodec *codec = detectCodec(&begin,end);
+    parseParallel(begin,end,codec,data,stats);
+    return true;
+}
+
+//保存。文件名以.chtb结尾时保存为二进制
+bool ChartFile::write(const QString &fileName, const ChartData &data, QString *error, const Progress &progress)
+{
+    QSaveFile file(fileName);
+    if(!file.open(QFile::WriteOnly)){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    bool canceled = false;
+    const Progress report = [&](int rows){
+        canceled = progress && !progress(rows);
+        return !canceled;
+    };
+    const bool ok = isBinaryName(fileName) ? writeBinary(&file,data,report) : writeText(&file,data,report);
+    if(!ok){
+        if(error)
+            *error = canceled ? QStringLiteral("已取消") : file.errorString();
+        file.cancelWriting(); //丢弃临时文件，原文件不变
+        return false;
+    }
+    //替换原文件
+    if(!file.commit()){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+//文件名是否表示二进制格式
+bool ChartFile::isBinaryName(const QString &fileName)
+{
+    return fileName.endsWith(QLatin1String(".chtb"),Qt::CaseInsensitive);
+}
+
+//写出文本格式。每行直接从各列格式化到缓冲区，攒够1MB写一次
+bool ChartFile::writeText(QIODevice *device, const ChartData &data, const Progress &progress)
+{
+    static const char hex[] = "0123456789abcdef";
+    const int flushSize = 1 << 20;
+    QByteArray buffer;
+    buffer.reserve(flushSize + 4096);
+    buffer.append("\xEF\xBB\xBF"); //BOM，读取时按UTF-8解码
+    QVector<QByteArray> utf8(data.labels.size()); //每个不同的标签只转换一次
+    for(int row = 0; row < data.size(); ++row){
+        const quint32 id = data.labelIds[size_t(row)];
+        if(utf8.at(int(id)).isNull())
+            utf8[int(id)] = data.labels.view(id).toUtf8();
+        buffer += utf8.at(int(id));
+        buffer += ',';
+        buffer += QByteArray::number(data.values[size_t(row)],'g',QLocale::FloatingPointShortest);
+
+        //颜色写成",#rrggbb\n"
+        const QRgb rgb = data.colors[size_t(row)];
+        char color[9];
+        color[0] = ',';
+        color[1] = '#';
+        for(int i = 0; i < 6; ++i)
+            color[2 + i] = hex[(rgb >> (20 - 4 * i)) & 0xf];
+        color[8] = '\n';
+        buffer.append(color,9);
+
+        if(buffer.size() >= flushSize){
+            if(device->write(buffer) != buffer.size())
+                return false;
+            buffer.resize(0); //保留已分配的空间
+            if(progress && !progress(row + 1))
+                return false;
+        }
+    }
+    if(device->write(buffer) != buffer.size())
+        return false;
+    return !progress || progress(data.size());
+}
+
+static_assert(sizeof(ChartBinaryHeader) == 64,"ChartBinaryHeader must not contain padding");
+
+//对齐到8字节
+static quint64 align8(quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+//按小端写出一个数组。小端机器上直接写出内存
+template <typename T>
+static bool writeArray(QIODevice *device, const T *values, qint64 count)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    const qint64 bytes = count * qint64(sizeof(T));
+    return device->write(reinterpret_cast<const char *>(values),bytes) == bytes;
+#else
+    T buffer[4096];
+    for(qint64 i = 0; i < count; i += 4096){
+        const qint64 n = qMin<qint64>(4096,count - i);
+        qToLittleEndian<T>(values + i,n,buffer);
+        if(device->write(reinterpret_cast<const char *>(buffer),n * qint64(sizeof(T))) != n * qint64(sizeof(T)))
+            return false;
+    }
+    return true;
+#endif
+}
+
+//补0直到offset对齐到8字节
+static bool writePadding(QIODevice *device, quint64 *offset)
+{
+    static const char zeros[8] = {};
+    const quint64 aligned = align8(*offset);
+    const qint64 bytes = qint64(aligned - *offset);
+    *offset = aligned;
+    return bytes == 0 || device->write(zeros,bytes) == bytes;
+}
+
+//写出二进制格式。内存中的标签字典和每行的编号原样写出
+bool ChartFile::writeBinary(QIODevice *device, const ChartData &data, const Progress &progress)
+{
+    const quint32 rows = quint32(data.size());
+    const ChartLabels &labels = data.labels;
+
+    QVector<quint32> labelIndex;
+    labelIndex.reserve(labels.size() + 1);
+    quint32 units = 0; //字符串表的UTF-16单元数
+    for(int i = 0; i < labels.size(); ++i){
+        labelIndex.append(units);
+        units += quint32(labels.view(quint32(i)).size());
+    }
+    labelIndex.append(units);
+
+    //各块的位置
+    ChartBinaryHeader header;
+    std::memcpy(header.magic,"CHTB",4);
+    header.version = 1;
+    header.rows = rows;
+    header.labels = quint32(labels.size());
+    header.valuesOffset = align8(sizeof(ChartBinaryHeader));
+    header.colorsOffset = align8(header.valuesOffset + quint64(rows) * sizeof(double));
+    header.labelIdsOffset = align8(header.colorsOffset + quint64(rows) * sizeof(quint32));
+    header.labelIndexOffset = align8(header.labelIdsOffset + quint64(rows) * sizeof(quint32));
+    header.labelDataOffset = align8(header.labelIndexOffset + quint64(labelIndex.size()) * sizeof(quint32));
+    header.fileSize = header.labelDataOffset + quint64(units) * sizeof(quint16);
+
+    //文件头按小端写出
+    ChartBinaryHeader little = header;
+    little.version = qToLittleEndian(header.version);
+    little.rows = qToLittleEndian(header.rows);
+    little.labels = qToLittleEndian(header.labels);
+    little.valuesOffset = qToLittleEndian(header.valuesOffset);
+    little.colorsOffset = qToLittleEndian(header.colorsOffset);
+    little.labelIdsOffset = qToLittleEndian(header.labelIdsOffset);
+    little.labelIndexOffset = qToLittleEndian(header.labelIndexOffset);
+    little.labelDataOffset = qToLittleEndian(header.labelDataOffset);
+    little.fileSize = qToLittleEndian(header.fileSize);
+    if(device->write(reinterpret_cast<const char *>(&little),sizeof(little)) != qint64(sizeof(little)))
+        return false;
+
+    quint64 offset = sizeof(ChartBinaryHeader);
+    bool ok = writePadding(device,&offset)
+            && writeArray(device,reinterpret_cast<const quint64 *>(data.values.data()),rows);
+    offset += quint64(rows) * sizeof(double);
+    ok = ok && writePadding(device,&offset) && writeArray(device,reinterpret_cast<const quint32 *>(data.colors.data()),rows);
+    offset += quint64(rows) * sizeof(quint32);
+    ok = ok && writePadding(device,&offset) && writeArray(device,data.labelIds.data(),rows);
+    offset += quint64(rows) * sizeof(quint32);
+    ok = ok && writePadding(device,&offset) && writeArray(device,labelIndex.constData(),labelIndex.size());
+    offset += quint64(labelIndex.size()) * sizeof(quint32);
+    ok = ok && writePadding(device,&offset);
+    for(int i = 0; ok && i < labels.size(); ++i){
+        const QStringView label = labels.view(quint32(i));
+        ok = writeArray(device,reinterpret_cast<const quint16 *>(label.utf16()),label.size());
+    }
+    return ok && (!progress || progress(int(rows)));
+}
+
+//内存中的数据是否以二进制格式的标记开头
+bool ChartFile::isBinary(const char *begin, const char *end)
+{
+    return end - begin >= 4 && std::memcmp(begin,"CHTB",4) == 0;
+}
+
+//读取并检查二进制文件头。各块都必须完整地在文件内
+bool ChartFile::binaryHeader(const char *begin, const char *end, ChartBinaryHeader *header, QString *error)
+{
+    const quint64 size = quint64(end - begin);
+    auto fail = [error](const QString &reason){
+        if(error)
+            *error = reason;
+        return false;
+    };
+    if(size < sizeof(ChartBinaryHeader) || !isBinary(begin,end))
+        return fail(QStringLiteral("不是图表二进制文件"));
+
+    std::memcpy(header,begin,sizeof(ChartBinaryHeader));
+    header->version = qFromLittleEndian(header->version);
+    header->rows = qFromLittleEndian(header->rows);
+    header->labels = qFromLittleEndian(header->labels);
+    header->valuesOffset = qFromLittleEndian(header->valuesOffset);
+    header->colorsOffset = qFromLittleEndian(header->colorsOffset);
+    header->labelIdsOffset = qFromLittleEndian(header->labelIdsOffset);
+    header->labelIndexOffset = qFromLittleEndian(header->labelIndexOffset);
+    header->labelDataOffset = qFromLittleEndian(header->labelDataOffset);
+    header->fileSize = qFromLittleEndian(header->fileSize);
+
+    if(header->version != 1)
+        return fail(QStringLiteral("不支持的二进制文件版本 %1").arg(header->version));
+    if(header->fileSize != size || header->rows > quint32(INT_MAX) || header->labels >= quint32(INT_MAX))
+        return fail(QStringLiteral("二进制文件不完整"));
+
+    //偏移由文件给出，可以是任意值。先检查偏移在文件头之后、文件之内并按8字节对齐，
+    //再与偏移之后剩下的字节数比较，不做偏移加长度，不会溢出。行数和标签数都小于2^31，长度不超过2^35
+    auto inFile = [size](quint64 offset, quint64 bytes){
+        return offset >= sizeof(ChartBinaryHeader) && offset <= size && offset % 8 == 0 && bytes <= size - offset;
+    };
+    const quint64 rows = header->rows;
+    if(!inFile(header->valuesOffset,rows * sizeof(double))
+            || !inFile(header->colorsOffset,rows * sizeof(quint32))
+            || !inFile(header->labelIdsOffset,rows * sizeof(quint32))
+            || !inFile(header->labelIndexOffset,(quint64(header->labels) + 1) * sizeof(quint32))
+            || !inFile(header->labelDataOffset,0))
+        return fail(QStringLiteral("二进制文件不完整"));
+
+    const quint32 units = qFromLittleEndian<quint32>(begin + header->labelIndexOffset + quint64(header->labels) * sizeof(quint32));
+    if(!inFile(header->labelDataOffset,quint64(units) * sizeof(quint16)))
+        return fail(QStringLiteral("二进制文件不完整"));
+    return true;
+}
+
+//解码标签字典。每个不同的标签只解码一次，放进字典。
+//文件中的字典一般没有重复，ids通常就是0,1,2...；索引损坏或标签重复时几个文件编号对应同一个字典编号
+ChartLabels ChartFile::binaryLabels(const char *begin, const ChartBinaryHeader &header, QVector<quint32> *ids)
+{
+    const char *index = begin + header.labelIndexOffset;
+    const char *text = begin + header.labelDataOffset;
+    const quint32 units = qFromLittleEndian<quint32>(index + quint64(header.labels) * sizeof(quint32));
+
+    ChartLabels labels;
+    labels.reserve(int(header.labels),int(qMin<quint32>(units,INT_MAX)));
+    ids->resize(int(header.labels));
+    QString label;
+    quint32 start = qFromLittleEndian<quint32>(index);
+    for(quint32 i = 0; i < header.labels; ++i){
+        const quint32 stop = qFromLittleEndian<quint32>(index + (quint64(i) + 1) * sizeof(quint32));
+        if(start > stop || stop > units){ //索引损坏时用空标签
+            (*ids)[int(i)] = labels.intern(QStringView());
+        }else{
+            label.resize(int(stop - start));
+            qFromLittleEndian<quint16>(text + quint64(start) * sizeof(quint16),stop - start,label.data());
+            (*ids)[int(i)] = labels.intern(label);
+        }
+        start = stop;
+    }
+    return labels;
+}
+
+//从二进制文件复制行。数值和颜色整块复制，小端机器上就是memcpy
+void ChartFile::readBinaryRows(const char *begin, const ChartBinaryHeader &header, const ChartLabels &labels,
+                               const QVector<quint32> &ids, int first, int count, ChartData *data)
+{
+    first = qBound(0,first,int(header.rows));
+    count = qBound(0,count,int(header.rows) - first);
+    if(count == 0)
+        return;
+
+    const size_t old = data->values.size();
+    data->values.resize(old + size_t(count));
+    qFromLittleEndian<quint64>(begin + header.valuesOffset + quint64(first) * sizeof(double),count,data->values.data() + old);
+    data->colors.resize(old + size_t(count));
+    qFromLittleEndian<quint32>(begin + header.colorsOffset + quint64(first) * sizeof(quint32),count,data->colors.data() + old);
+
+    //空的data直接共用文件的字典，只换算编号，不复制字符；已有别的字典时先把文件字典合并进去
+    if(data->size() == 0 && data->labels.size() == 0)
+        data->labels = labels;
+    QVector<quint32> map = ids;
+    if(!data->labels.isSharedWith(labels)){
+        const QVector<quint32> merged = data->mergeLabels(labels);
+        for(quint32 &id : map)
+            id = merged.at(int(id));
+    }
+    int empty = -1; //编号超出字典时用的空标签，用到时才加进字典
+    const char *rowIds = begin + header.labelIdsOffset + quint64(first) * sizeof(quint32);
+    data->labelIds.reserve(data->labelIds.size() + size_t(count));
+    for(int i = 0; i < count; ++i){
+        const quint32 id = qFromLittleEndian<quint32>(rowIds + quint64(i) * sizeof(quint32));
+        if(id < quint32(map.size())){
+            data->labelIds.push_back(map.at(int(id)));
+        }else{
+            if(empty < 0)
+                empty = int(data->labels.intern(QStringView()));
+            data->labelIds.push_back(quint32(empty));
+        }
+    }
+}
@@ -0,0 +1,79 @@
+﻿#ifndef CHARTFILE_H
+#define CHARTFILE_H
+
+#include "chartmodel.h"
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QTextCodec;
+QT_END_NAMESPACE
+
+//加载结果统计
+struct ChartLoadStats
+{
+    int lines = 0; //已解析的行数，包括空行和格式错误的行
+    int rows = 0; //成功读取的行数
+    int malformedLines = 0; //格式错误被跳过的行数
+    int firstMalformedLine = 0; //第一处格式错误的行号，从1开始
+};
+
+//.chtb二进制文件的文件头。文件中所有数值都是小端，各数据块按8字节对齐：
+//文件头、数值块double[rows]、颜色块quint32[rows](0xAARRGGBB)、标签编号块quint32[rows]、
+//标签索引quint32[labels+1](每个标签在字符串表中的起点，UTF-16单元)、字符串表(UTF-16)
+struct ChartBinaryHeader
+{
+    char magic[4]; //"CHTB"
+    quint32 version; //格式版本，目前为1
+    quint32 rows; //行数
+    quint32 labels; //不重复的标签数
+    quint64 valuesOffset;
+    quint64 colorsOffset;
+    quint64 labelIdsOffset;
+    quint64 labelIndexOffset;
+    quint64 labelDataOffset;
+    quint64 fileSize; //整个文件的字节数，用于检查文件是否完整
+};
+
+//图表文件的读写。.cht为文本，每行为"标签,数值,#rrggbb"，文件为带BOM的UTF-8或本地编码(如GBK)；
+//.chtb为按列存储的二进制格式，映射到内存后直接复制各列，不需要逐行解析
+namespace ChartFile
+{
+    //把整个文件映射到内存后读取到data。根据文件开头判断是文本还是二进制。文件打不开返回false，error为原因
+    bool read(const QString &fileName, ChartData *data, ChartLoadStats *stats, QString *error = nullptr);
+
+    //保存进度回调，参数为已写出的行数。返回false时停止保存
+    using Progress = std::function<bool(int rows)>;
+
+    //保存。文件名以.chtb结尾时保存为二进制，否则保存为带BOM的UTF-8文本。
+    //先写到同一目录下的临时文件，全部写完才替换原文件，中途失败或取消时原文件不变
+    bool write(const QString &fileName, const ChartData &data, QString *error = nullptr, const Progress &progress = Progress());
+    //文件名是否表示二进制格式
+    bool isBinaryName(const QString &fileName);
+
+    //写出文本格式，数据直接从各列格式化到大块缓冲区。每写出一块报告一次进度
+    bool writeText(QIODevice *device, const ChartData &data, const Progress &progress = Progress());
+    //写出二进制格式。建标签字典时报告进度
+    bool writeBinary(QIODevice *device, const ChartData &data, const Progress &progress = Progress());
+
+    //内存中的数据是否以二进制格式的标记开头
+    bool isBinary(const char *begin, const char *end);
+    //读取并检查二进制文件头。文件不完整或版本不支持时返回false
+    bool binaryHeader(const char *begin, const char *end, ChartBinaryHeader *header, QString *error = nullptr);
+    //解码二进制文件的标签字典。ids为文件中每个标签编号对应的字典编号
+    ChartLabels binaryLabels(const char *begin, const ChartBinaryHeader &header, QVector<quint32> *ids);
+    //从二进制文件复制第first行开始的count行，追加到data。labels和ids是binaryLabels的结果
+    void readBinaryRows(const char *begin, const ChartBinaryHeader &header, const ChartLabels &labels,
+                        const QVector<quint32> &ids, int first, int count, ChartData *data);
+
+    //根据文件开头判断标签的编码，跳过BOM。返回nullptr表示UTF-8
+    QTextCodec *detectCodec(const char **begin, const char *end);
+
+    //在当前线程解析内存中的一段文本，追加到data。行号接着stats->lines往后数
+    void parse(const char *begin, const char *end, QTextCodec *codec, ChartData *data, ChartLoadStats *stats);
+
+    //按换行符把文本分块，用threads个线程同时解析后按顺序合并。threads为0时使用全部核心
+    void parseParallel(const char *begin, const char *end, QTextCodec *codec, ChartData *data, ChartLoadStats *stats, int threads = 0);
+}
+
+#endif // CHARTFILE_H
@@ -0,0 +1,126 @@
+﻿#include "chartlabels.h"
+#include <QHash>
+#include <algorithm>
+
+class ChartLabelsData : public QSharedData
+{
+public:
+    QVector<QChar> arena; //所有标签的字符，首尾相接
+    QVector<quint32> ends; //每个标签在arena中的终点，起点为前一个标签的终点
+    QVector<uint> hashes; //每个标签的哈希值，扩大哈希表时不用重算
+    QVector<quint32> table; //开放寻址的哈希表，存编号+1，0为空位。大小为2的幂
+
+    QStringView view(int id) const
+    {
+        const quint32 start = id > 0 ? ends.at(id - 1) : 0;
+        return QStringView(arena.constData() + start,qsizetype(ends.at(id) - start));
+    }
+
+    //查找标签，找不到时slot为应该放入的空位
+    int lookup(QStringView label, uint hash, int *slot) const
+    {
+        *slot = -1;
+        if(table.isEmpty())
+            return -1;
+        const int mask = table.size() - 1;
+        for(int i = int(hash & uint(mask)); ; i = (i + 1) & mask){
+            const quint32 entry = table.at(i);
+            if(entry == 0){
+                *slot = i;
+                return -1;
+            }
+            const int id = int(entry - 1);
+            if(hashes.at(id) == hash && view(id) == label)
+                return id;
+        }
+    }
+
+    //把哈希表扩大到size个位置，重新放入所有标签
+    void rehash(int size)
+    {
+        table.fill(0,size);
+        const int mask = size - 1;
+        for(int id = 0; id < hashes.size(); ++id){
+            int i = int(hashes.at(id) & uint(mask));
+            while(table.at(i))
+                i = (i + 1) & mask;
+            table[i] = quint32(id + 1);
+        }
+    }
+};
+
+ChartLabels::ChartLabels() = default;
+ChartLabels::ChartLabels(const ChartLabels &other) = default;
+ChartLabels::ChartLabels(ChartLabels &&other) noexcept = default;
+ChartLabels &ChartLabels::operator=(const ChartLabels &other) = default;
+ChartLabels &ChartLabels::operator=(ChartLabels &&other) noexcept = default;
+ChartLabels::~ChartLabels() = default;
+
+int ChartLabels::size() const
+{
+    return d ? d->hashes.size() : 0;
+}
+
+quint32 ChartLabels::intern(QStringView label)
+{
+    const uint hash = qHash(label);
+    int slot = -1;
+    if(!d){
+        d = new ChartLabelsData;
+    }else{
+        //只读查找，不触发复制
+        const int id = d.constData()->lookup(label,hash,&slot);
+        if(id >= 0)
+            return quint32(id);
+    }
+
+    //有其他副本时在这里复制一份。装载率超过一半时扩大哈希表
+    ChartLabelsData *data = d.data();
+    if((data->hashes.size() + 1) * 2 > data->table.size()){
+        data->rehash(qMax(16,data->table.size() * 2));
+        data->lookup(label,hash,&slot);
+    }
+    const quint32 id = quint32(data->hashes.size());
+    const int start = data->arena.size();
+    data->arena.resize(start + int(label.size()));
+    std::copy(label.begin(),label.end(),data->arena.begin() + start);
+    data->ends.append(quint32(data->arena.size()));
+    data->hashes.append(hash);
+    data->table[slot] = id + 1;
+    return id;
+}
+
+int ChartLabels::find(QStringView label) const
+{
+    if(!d)
+        return -1;
+    int slot;
+    return d->lookup(label,qHash(label),&slot);
+}
+
+QStringView ChartLabels::view(quint32 id) const
+{
+    if(!d || id >= quint32(d->hashes.size()))
+        return QStringView();
+    return d->view(int(id));
+}
+
+void ChartLabels::reserve(int labels, int characters)
+{
+    if(!d)
+        d = new ChartLabelsData;
+    ChartLabelsData *data = d.data();
+    data->arena.reserve(characters);
+    data->ends.reserve(labels);
+    data->hashes.reserve(labels);
+    int size = qMax(16,data->table.size());
+    while(size < labels * 2)
+        size *= 2;
+    if(size > data->table.size())
+        data->rehash(size);
+}
+
+void ChartLabels::clear()
+{
+    d = QSharedDataPointer<ChartLabelsData>();
+}
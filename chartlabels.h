@@ -0,0 +1,46 @@
+﻿#ifndef CHARTLABELS_H
+#define CHARTLABELS_H
+
+#include <QSharedDataPointer>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+class ChartLabelsData;
+
+//标签字典。每个不同的标签只存一份，行中只保存4字节的编号，比较、分组和按标签查找都是整数比较。
+//所有标签的字符按UTF-16首尾相接存放在一块缓冲区(arena)中，不为每个标签单独分配内存；查找用开放寻址的哈希表。
+//隐式共享：复制只增加引用计数，添加标签时才复制，快照交给后台线程后界面线程可以继续添加
+class ChartLabels
+{
+public:
+    ChartLabels();
+    ChartLabels(const ChartLabels &other);
+    ChartLabels(ChartLabels &&other) noexcept;
+    ChartLabels &operator=(const ChartLabels &other);
+    ChartLabels &operator=(ChartLabels &&other) noexcept;
+    ~ChartLabels();
+
+    //不同标签的个数，编号为0到size()-1
+    int size() const;
+    //标签的编号，没有时添加到末尾
+    quint32 intern(QStringView label);
+    //标签的编号，没有时返回-1
+    int find(QStringView label) const;
+    //编号对应的标签，直接指向字典中的字符。字典添加标签后失效
+    QStringView view(quint32 id) const;
+    //编号对应的标签，复制成QString
+    QString label(quint32 id) const { return view(id).toString(); }
+
+    //预留labels个标签、共characters个字符的空间
+    void reserve(int labels, int characters);
+    void clear();
+    //两个字典是否是同一份数据，是时编号可以直接通用
+    bool isSharedWith(const ChartLabels &other) const { return d == other.d; }
+
+private:
+    //第一次添加前为空，空字典不分配内存
+    QSharedDataPointer<ChartLabelsData> d;
+};
+
+#endif // CHARTLABELS_H
@@ -0,0 +1,259 @@
+﻿#include "chartloader.h"
+#include "chartprofiler.h"
+#include <QAtomicInteger>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <cstring>
+#include <deque>
+
+//一次加载任务。后台线程写入，界面线程读取
+struct ChartLoadJob
+{
+    QString fileName;
+    QAtomicInt canceled; //界面线程设置，后台线程每解析一块检查一次
+    QAtomicInteger<qint64> bytesRead; //已解析的字节数
+    QAtomicInteger<qint64> totalBytes;
+    int batchRows = 100000; //二进制文件每批的行数，不超过界面线程每次交给模型的行数
+    //界面线程从队列取出、正在分几次交给模型的一批，以及已交出的行数。只在界面线程使用
+    ChartData current;
+    int currentOffset = 0;
+
+    //以下由mutex保护
+    QMutex mutex;
+    QWaitCondition drained; //界面线程取走数据或取消时唤醒后台线程
+    std::deque<ChartData> batches; //解析好、还没交给模型的数据
+    bool done = false; //后台线程已结束
+    QString error; //打不开文件时的原因
+    ChartLoadStats stats; //done之后才能在界面线程读取
+};
+
+//队列中最多的批数。后台线程比界面线程快时在这里等待，不会把整个文件都读进队列
+static const int maxQueuedBatches = 4;
+
+//把一批数据放进队列，队列满时等界面线程取走。取消时返回false
+static bool pushBatch(ChartLoadJob *job, ChartData &&batch)
+{
+    QMutexLocker locker(&job->mutex);
+    while(int(job->batches.size()) >= maxQueuedBatches && !job->canceled.loadAcquire())
+        job->drained.wait(&job->mutex);
+    if(job->canceled.loadAcquire())
+        return false;
+    job->batches.push_back(std::move(batch));
+    return true;
+}
+
+//后台线程：映射文件，按块解析后放入队列。二进制文件按行数分批
+static void runJob(const QSharedPointer<ChartLoadJob> &job)
+{
+    //每块的大小。块内仍然多线程解析，块越小进度越细
+    const qint64 window = 2 << 20;
+
+    QFile file(job->fileName);
+    if(!file.open(QFile::ReadOnly)){
+        QMutexLocker locker(&job->mutex);
+        job->error = file.errorString();
+        job->done = true;
+        return;
+    }
+
+    QByteArray buffer;
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    if(file.size() > 0){
+        //映射失败时(如压缩过的资源文件)一次读入
+        if(uchar *mapped = file.map(0,file.size())){
+            begin = reinterpret_cast<const char *>(mapped);
+            end = begin + file.size();
+        }else{
+            buffer = file.readAll();
+            begin = buffer.constData();
+            end = begin + buffer.size();
+        }
+    }
+    job->totalBytes.storeRelease(end - begin);
+
+    //二进制文件不用解析，按固定行数分批复制各列
+    if(ChartFile::isBinary(begin,end)){
+        ChartBinaryHeader header;
+        QString error;
+        if(!ChartFile::binaryHeader(begin,end,&header,&error)){
+            QMutexLocker locker(&job->mutex);
+            job->error = error;
+            job->done = true;
+            return;
+        }
+        //各批共用同一份字典，编号直接对应，合并时不用换算
+        QVector<quint32> ids;
+        const ChartLabels labels = ChartFile::binaryLabels(begin,header,&ids);
+        const int rows = int(header.rows);
+        const int batchRows = job->batchRows;
+        for(int first = 0; first < rows && !job->canceled.loadAcquire(); first += batchRows){
+            ChartData batch;
+            ChartFile::readBinaryRows(begin,header,labels,ids,first,batchRows,&batch);
+            if(!pushBatch(job.data(),std::move(batch)))
+                break;
+            job->bytesRead.storeRelease(qint64(end - begin) * qMin(first + batchRows,rows) / rows);
+        }
+        QMutexLocker locker(&job->mutex);
+        job->stats.lines = job->stats.rows = rows;
+        job->done = true;
+        return;
+    }
+
+    const char *start = begin; //进度按包括BOM在内的整个文件计算
+    QTextCodec *codec = begin ? ChartFile::detectCodec(&begin,end) : nullptr;
+    ChartLoadStats stats; //行号跨块连续
+    const char *p = begin;
+    while(p < end && !job->canceled.loadAcquire()){
+        const char *windowEnd = end - p > window ? p + window : end;
+        //对齐到换行符之后，每块都是整行
+        if(windowEnd < end){
+            const char *newline = static_cast<const char *>(std::memchr(windowEnd,'\n',size_t(end - windowEnd)));
+            windowEnd = newline ? newline + 1 : end;
+        }
+
+        ChartData batch;
+        {
+            ChartProfileScope profile(ChartProfiler::LoadParse);
+            ChartFile::parseParallel(p,windowEnd,codec,&batch,&stats);
+        }
+        p = windowEnd;
+        if(!pushBatch(job.data(),std::move(batch)))
+            break;
+        job->bytesRead.storeRelease(p - start);
+    }
+
+    QMutexLocker locker(&job->mutex);
+    job->stats = stats;
+    job->done = true;
+}
+
+ChartLoader::ChartLoader(ChartModel *model, QObject *parent):QObject(parent),model(model)
+{
+    //大约每秒30次把数据交给模型
+    drainTimer.setInterval(33);
+    connect(&drainTimer,&QTimer::timeout,this,&ChartLoader::drain);
+}
+
+ChartLoader::~ChartLoader()
+{
+    //窗口正在析构，不再发出信号
+    blockSignals(true);
+    cancel();
+}
+
+//开始加载
+void ChartLoader::load(const QString &fileName)
+{
+    cancel(); //第二次打开时先干净地结束第一次
+
+    model->setChartData(ChartData()); //清空模型
+    rowsLoaded = 0;
+    job.reset(new ChartLoadJob);
+    job->fileName = fileName;
+    job->batchRows = qMax(1,rowsPerTick);
+    loadStart = ChartProfiler::isEnabled() ? ChartProfiler::now() : -1;
+
+    QSharedPointer<ChartLoadJob> running = job;
+    thread = QThread::create([running]{ runJob(running); });
+    thread->start();
+    drainTimer.start();
+}
+
+//取消正在进行的加载。后台线程每解析完一块就检查一次，所以等待的时间很短
+void ChartLoader::cancel()
+{
+    if(!job)
+        return;
+
+    job->canceled.storeRelease(1);
+    {
+        //后台线程可能在等队列空出位置
+        QMutexLocker locker(&job->mutex);
+        job->drained.wakeAll();
+    }
+    if(thread){
+        thread->wait();
+        delete thread;
+        thread = nullptr;
+    }
+    drainTimer.stop();
+
+    //队列里还没交给模型的数据直接丢弃
+    const QString fileName = job->fileName;
+    job.reset();
+    emit canceled(fileName,rowsLoaded);
+}
+
+//是否正在加载
+bool ChartLoader::isLoading() const
+{
+    return !job.isNull();
+}
+
+//把队列中的数据交给模型。每次最多rowsPerTick行，比这大的一批拆开，剩下的留到下一次。之后报告进度
+void ChartLoader::drain()
+{
+    if(!job)
+        return;
+
+    //每次最多交出rowsPerTick行。一批比它大时记下偏移，下次从偏移处接着交，不复制剩下的部分
+    const int limit = qMax(1,rowsPerTick);
+    int rows = 0;
+    while(rows < limit){
+        if(job->currentOffset >= job->current.size()){
+            QMutexLocker locker(&job->mutex);
+            if(job->batches.empty())
+                break;
+            job->current = std::move(job->batches.front());
+            job->batches.pop_front();
+            job->currentOffset = 0;
+            job->drained.wakeAll();
+            continue;
+        }
+        const int take = qMin(limit - rows,job->current.size() - job->currentOffset);
+        {
+            ChartProfileScope profile(ChartProfiler::LoadAppend);
+            model->appendChartData(job->current,job->currentOffset,take);
+        }
+        job->currentOffset += take;
+        rows += take;
+        rowsLoaded += take;
+    }
+    //交完的一批立即释放
+    if(job->currentOffset >= job->current.size()){
+        job->current = ChartData();
+        job->currentOffset = 0;
+    }
+
+    bool done;
+    QString error;
+    {
+        QMutexLocker locker(&job->mutex);
+        done = job->done && job->batches.empty() && job->current.size() == 0;
+        error = job->error;
+    }
+    emit progress(job->bytesRead.loadAcquire(),job->totalBytes.loadAcquire());
+
+    if(!done)
+        return;
+
+    //后台线程已经结束
+    drainTimer.stop();
+    if(thread){
+        thread->wait();
+        delete thread;
+        thread = nullptr;
+    }
+    const QString fileName = job->fileName;
+    const ChartLoadStats stats = job->stats;
+    job.reset();
+    if(loadStart >= 0)
+        ChartProfiler::record(ChartProfiler::LoadFile,loadStart,ChartProfiler::now());
+    if(!error.isEmpty())
+        emit failed(fileName,error);
+    else
+        emit finished(fileName,stats);
+}
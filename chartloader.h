@@ -0,0 +1,59 @@
+﻿#ifndef CHARTLOADER_H
+#define CHARTLOADER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include "chartfile.h"
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+struct ChartLoadJob;
+
+//在后台线程读取.cht文件。解析好的数据一批一批放进队列，
+//界面线程的定时器按固定节奏取出交给模型，视图因此逐步显示出来而不会卡住。
+//队列只放几批，后台线程比界面线程快时等待，内存中不会堆积整个文件
+class ChartLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    ChartLoader(ChartModel *model, QObject *parent = nullptr);
+    //取消正在进行的加载并等待后台线程结束
+    ~ChartLoader();
+
+    //开始加载。正在加载的文件会先被取消，模型先清空
+    void load(const QString &fileName);
+    //取消正在进行的加载，已经显示的数据保留
+    void cancel();
+    //是否正在加载
+    bool isLoading() const;
+
+    //每次定时器最多交给模型的行数，限制每一帧的插入量。二进制文件也按这个行数分批，下次load时生效
+    void setRowsPerTick(int rows) { rowsPerTick = rows; }
+
+signals:
+    //已读取的字节数和总字节数
+    void progress(qint64 bytesRead, qint64 totalBytes);
+    //全部加载完成
+    void finished(const QString &fileName, const ChartLoadStats &stats);
+    //被取消，rows为已经加载的行数
+    void canceled(const QString &fileName, int rows);
+    //文件打不开
+    void failed(const QString &fileName, const QString &error);
+
+private:
+    //定时器：把队列中的数据交给模型，并报告进度
+    void drain();
+
+    ChartModel *model = nullptr;
+    QSharedPointer<ChartLoadJob> job; //当前的加载任务，后台线程也持有一份
+    QThread *thread = nullptr; //当前任务的后台线程
+    QTimer drainTimer;
+    int rowsPerTick = 100000;
+    int rowsLoaded = 0; //已交给模型的行数
+    qint64 loadStart = -1; //load的时间，完成或失败时记录整个加载的耗时。计时关闭时为-1
+};
+
+#endif // CHARTLOADER_H
@@ -0,0 +1,317 @@
+﻿#include "chartmodel.h"
+#include "chartprofiler.h"
+#include <algorithm>
+#include <climits>
+
+//预留行的空间
+void ChartData::reserve(int rows)
+{
+    labelIds.reserve(size_t(rows));
+    values.reserve(size_t(rows));
+    colors.reserve(size_t(rows));
+}
+
+void ChartData::clear()
+{
+    labels.clear();
+    labelIds.clear();
+    values.clear();
+    colors.clear();
+}
+
+//在末尾添加一行。标签已在字典中时只查一次哈希表，不复制字符
+void ChartData::append(QStringView label, double value, QRgb color)
+{
+    labelIds.push_back(labels.intern(label));
+    values.push_back(value);
+    colors.push_back(color);
+}
+
+//接上另一组数据。自己是空的时直接共用它的字典
+void ChartData::append(const ChartData &other)
+{
+    append(other,0,other.size());
+}
+
+void ChartData::append(const ChartData &other, int first, int count)
+{
+    first = qBound(0,first,other.size());
+    count = qBound(0,count,other.size() - first);
+    if(count == 0)
+        return;
+    if(size() == 0 && labels.size() == 0)
+        labels = other.labels;
+
+    const auto from = other.labelIds.begin() + first;
+    const auto to = from + count;
+    if(labels.isSharedWith(other.labels)){
+        labelIds.insert(labelIds.end(),from,to);
+    }else{
+        const QVector<quint32> ids = mergeLabels(other.labels);
+        labelIds.reserve(labelIds.size() + size_t(count));
+        for(auto it = from; it != to; ++it)
+            labelIds.push_back(ids.at(int(*it)));
+    }
+    values.insert(values.end(),other.values.begin() + first,other.values.begin() + first + count);
+    colors.insert(colors.end(),other.colors.begin() + first,other.colors.begin() + first + count);
+}
+
+QVector<quint32> ChartData::mergeLabels(const ChartLabels &other)
+{
+    QVector<quint32> ids(other.size());
+    for(int id = 0; id < other.size(); ++id)
+        ids[id] = labels.intern(other.view(quint32(id)));
+    return ids;
+}
+
+ChartModel::ChartModel(QObject *parent):QAbstractTableModel(parent)
+{
+}
+
+//行数。表格模型的项没有子项
+int ChartModel::rowCount(const QModelIndex &parent) const
+{
+    if(parent.isValid())
+        return 0;
+    return columns.size();
+}
+
+//列数：标签、数值
+int ChartModel::columnCount(const QModelIndex &parent) const
+{
+    if(parent.isValid())
+        return 0;
+    return 2;
+}
+
+//返回索引项的数据
+QVariant ChartModel::data(const QModelIndex &index, int role) const
+{
+    ChartProfiler::countDataCall();
+    if(!index.isValid() || index.row() >= columns.size())
+        return QVariant();
+
+    const int row = index.row();
+    switch (index.column()) {
+    case 0:
+        if(role == Qt::DisplayRole || role == Qt::EditRole)
+            return columns.label(row);
+        //颜色以图标的形式作为装饰呈现
+        if(role == Qt::DecorationRole)
+            return QColor(columns.colors[row]);
+        break;
+    case 1:
+        if(role == Qt::DisplayRole || role == Qt::EditRole)
+            return columns.values[row];
+        break;
+    }
+    return QVariant();
+}
+
+//设置索引项的数据。数据真正改变时才发出dataChanged
+bool ChartModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if(!index.isValid() || index.row() >= columns.size())
+        return false;
+
+    const int row = index.row();
+    if(index.column() == 0 && (role == Qt::DisplayRole || role == Qt::EditRole)){
+        //新标签先放进字典，比较编号即可知道是否改变
+        const quint32 id = columns.labels.intern(value.toString());
+        if(columns.labelIds[size_t(row)] == id)
+            return true;
+        columns.labelIds[size_t(row)] = id;
+        labelRowsValid = false;
+        emit dataChanged(index,index,{Qt::DisplayRole,Qt::EditRole});
+        return true;
+    }
+    if(index.column() == 0 && role == Qt::DecorationRole){
+        //可以是QColor，也可以是"#rrggbb"这样的颜色名
+        const QColor color = value.value<QColor>();
+        if(!color.isValid())
+            return false;
+        if(columns.colors[row] == color.rgb())
+            return true;
+        columns.colors[row] = color.rgb();
+        emit dataChanged(index,index,{Qt::DecorationRole});
+        return true;
+    }
+    if(index.column() == 1 && (role == Qt::DisplayRole || role == Qt::EditRole)){
+        bool ok = false;
+        const double number = value.toDouble(&ok);
+        if(!ok)
+            return false;
+        if(columns.values[row] == number)
+            return true;
+        columns.values[row] = number;
+        emit dataChanged(index,index,{Qt::DisplayRole,Qt::EditRole});
+        return true;
+    }
+    return false;
+}
+
+//所有项都可以选择和编辑
+Qt::ItemFlags ChartModel::flags(const QModelIndex &index) const
+{
+    if(!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsEnabled;
+}
+
+//表头。垂直表头显示行号
+QVariant ChartModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(role != Qt::DisplayRole)
+        return QVariant();
+    if(orientation == Qt::Horizontal){
+        if(section >= 0 && section < 2)
+            return headers[section];
+        return QVariant();
+    }
+    return section + 1;
+}
+
+//设置水平表头
+bool ChartModel::setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role)
+{
+    if(orientation != Qt::Horizontal || section < 0 || section >= 2 || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return false;
+    headers[section] = value.toString();
+    emit headerDataChanged(orientation,section,section);
+    return true;
+}
+
+//插入空行：空标签，数值0，黑色
+bool ChartModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if(parent.isValid() || row < 0 || row > columns.size() || count <= 0)
+        return false;
+
+    beginInsertRows(parent,row,row + count - 1);
+    labelRowsValid = false;
+    columns.labelIds.insert(columns.labelIds.begin() + row,size_t(count),columns.labels.intern(QStringView()));
+    columns.values.insert(columns.values.begin() + row,count,0.0);
+    columns.colors.insert(columns.colors.begin() + row,count,qRgb(0,0,0));
+    endInsertRows();
+    return true;
+}
+
+//删除行
+bool ChartModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if(parent.isValid() || row < 0 || count <= 0 || row + count > columns.size())
+        return false;
+
+    beginRemoveRows(parent,row,row + count - 1);
+    labelRowsValid = false;
+    columns.labelIds.erase(columns.labelIds.begin() + row,columns.labelIds.begin() + row + count);
+    columns.values.erase(columns.values.begin() + row,columns.values.begin() + row + count);
+    columns.colors.erase(columns.colors.begin() + row,columns.colors.begin() + row + count);
+    endRemoveRows();
+    return true;
+}
+
+//整体替换所有数据。视图收到modelReset后一次性重建，不会逐行处理插入和修改
+void ChartModel::setChartData(ChartData &&data)
+{
+    beginResetModel();
+    columns = std::move(data);
+    labelRowsValid = false;
+    labelRows.clear();
+    endResetModel();
+}
+
+//在末尾追加一批行。这批行的标签编号换算成模型字典中的编号
+void ChartModel::appendChartData(const ChartData &data)
+{
+    appendChartData(data,0,data.size());
+}
+
+void ChartModel::appendChartData(const ChartData &data, int first, int count)
+{
+    first = qBound(0,first,data.size());
+    count = qBound(0,count,data.size() - first);
+    if(count == 0)
+        return;
+
+    const int row = columns.size();
+    beginInsertRows(QModelIndex(),row,row + count - 1);
+    labelRowsValid = false;
+    columns.append(data,first,count);
+    endInsertRows();
+}
+
+//按标签合并更新。先改已有的行，数值和颜色各记下改动的行号范围，再把新标签一次追加
+int ChartModel::upsertChartData(const ChartData &updates, int maxRows)
+{
+    int firstValue = INT_MAX, lastValue = -1; //数值改动的行
+    int firstColor = INT_MAX, lastColor = -1; //颜色改动的行
+    int rejected = 0;
+    ChartData added;
+    for(int i = 0; i < updates.size(); ++i){
+        const QStringView label = updates.labelView(i);
+        const int row = rowForLabel(label);
+        if(row < 0){
+            //行数已满：新标签不加进模型，也不进字典
+            if(columns.size() + added.size() >= maxRows){
+                ++rejected;
+                continue;
+            }
+            //没有给颜色的新标签按标签取一个固定的颜色
+            const QRgb color = updates.colors[size_t(i)] ? updates.colors[size_t(i)]
+                                                         : QColor::fromHsv(int(qHash(label) % 360),160,230).rgb();
+            added.append(label,updates.values[size_t(i)],color);
+            continue;
+        }
+        if(columns.values[size_t(row)] != updates.values[size_t(i)]){
+            columns.values[size_t(row)] = updates.values[size_t(i)];
+            firstValue = qMin(firstValue,row);
+            lastValue = qMax(lastValue,row);
+        }
+        if(updates.colors[size_t(i)] && columns.colors[size_t(row)] != updates.colors[size_t(i)]){
+            columns.colors[size_t(row)] = updates.colors[size_t(i)];
+            firstColor = qMin(firstColor,row);
+            lastColor = qMax(lastColor,row);
+        }
+    }
+
+    //按标签匹配，标签本身不会变。数值只通知第1列，颜色只通知第0列的装饰，
+    //视图和代理不必把只改了数值的一批当成标签变化
+    if(lastValue >= 0)
+        emit dataChanged(index(firstValue,1),index(lastValue,1),{Qt::DisplayRole,Qt::EditRole});
+    if(lastColor >= 0)
+        emit dataChanged(index(firstColor,0),index(lastColor,0),{Qt::DecorationRole});
+
+    if(added.size() > 0){
+        //新行的标签也登记到索引中，下一批不用重建
+        const bool keepIndex = labelRowsValid;
+        const int first = columns.size();
+        appendChartData(added);
+        if(keepIndex){
+            const int known = labelRows.size();
+            labelRows.resize(columns.labels.size());
+            std::fill(labelRows.begin() + known,labelRows.end(),-1);
+            for(int row = first; row < columns.size(); ++row){
+                int &labelRow = labelRows[int(columns.labelIds[size_t(row)])];
+                if(labelRow < 0)
+                    labelRow = row;
+            }
+            labelRowsValid = true;
+        }
+    }
+    return rejected;
+}
+
+int ChartModel::rowForLabel(QStringView label) const
+{
+    const int id = columns.labels.find(label);
+    if(id < 0)
+        return -1;
+    if(!labelRowsValid){
+        labelRows.fill(-1,columns.labels.size());
+        for(int row = columns.size() - 1; row >= 0; --row)
+            labelRows[int(columns.labelIds[size_t(row)])] = row;
+        labelRowsValid = true;
+    }
+    return id < labelRows.size() ? labelRows.at(id) : -1;
+}
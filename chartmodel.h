@@ -0,0 +1,92 @@
+﻿#ifndef CHARTMODEL_H
+#define CHARTMODEL_H
+
+#include <QAbstractTableModel> //表格模型
+#include <QColor>
+#include <climits>
+#include <vector>
+#include "chartlabels.h"
+
+//一组图表数据，按列存储。文件先整体解析到这里，再一次性交给模型。
+//标签存在字典中，每行只有标签编号
+struct ChartData
+{
+    ChartLabels labels; //标签字典
+    std::vector<quint32> labelIds; //每行标签在字典中的编号
+    std::vector<double> values; //数值
+    std::vector<QRgb> colors; //颜色
+
+    int size() const { return int(labelIds.size()); }
+    void reserve(int rows);
+    void clear();
+    //在末尾添加一行
+    void append(QStringView label, double value, QRgb color);
+    //把other的所有行接在后面。字典不同时每个不同的标签只换算一次编号
+    void append(const ChartData &other);
+    //只接other中从第first行开始的count行
+    void append(const ChartData &other, int first, int count);
+    //other字典中每个编号在这个字典中的编号，没有的标签先添加
+    QVector<quint32> mergeLabels(const ChartLabels &other);
+
+    //第row行的标签
+    QStringView labelView(int row) const { return labels.view(labelIds[size_t(row)]); }
+    QString label(int row) const { return labels.label(labelIds[size_t(row)]); }
+};
+
+//图表数据模型。按列连续存储：标签数组、数值数组、颜色数组，每行不再分配QStandardItem。
+//第0列为标签，颜色作为第0列的DecorationRole；第1列为数值。
+class ChartModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    ChartModel(QObject *parent = nullptr);
+
+    //行数和列数。表格模型只有根项有行
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    //返回索引项的数据。第0列DisplayRole为标签、DecorationRole为颜色，第1列为数值
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    //设置索引项的数据。数值列只接受能转换成double的值
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    //表头
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role = Qt::EditRole) override;
+
+    //插入、删除行
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    //整体替换所有数据，只发出一次模型重置信号
+    void setChartData(ChartData &&data);
+    //在末尾追加一批行，只发出一次行插入信号
+    void appendChartData(const ChartData &data);
+    //只追加data中从第first行开始的count行，不用先复制出这一段
+    void appendChartData(const ChartData &data, int first, int count);
+    //按标签合并一批更新：标签已有的行改数值(颜色不为0时也改颜色)，没有的追加到末尾。
+    //数值修改对第1列、颜色修改对第0列的装饰各发出一次dataChanged，追加只发出一次行插入信号。updates中的标签不能重复。
+    //模型达到maxRows行后不再追加，新标签的更新被丢弃，已有的行照常修改。返回丢弃的新标签数
+    int upsertChartData(const ChartData &updates, int maxRows = INT_MAX);
+    //所有数据
+    const ChartData &chartData() const { return columns; }
+
+    //原始数据。视图可以直接按行号读取，跳过QVariant转换。标签按编号比较，需要文字时再查字典
+    const ChartLabels &labels() const { return columns.labels; }
+    const std::vector<quint32> &labelIds() const { return columns.labelIds; }
+    const std::vector<double> &values() const { return columns.values; }
+    const std::vector<QRgb> &colors() const { return columns.colors; }
+
+private:
+    //标签所在的行。先在字典中查到编号，再按编号找行，编号到行号的表第一次按标签更新时才建立
+    int rowForLabel(QStringView label) const;
+
+    ChartData columns; //标签、数值、颜色三列
+    mutable QVector<int> labelRows; //标签编号到行号，标签相同时取第一行，没有的为-1
+    mutable bool labelRowsValid = false;
+    QString headers[2]; //水平表头
+};
+
+#endif // CHARTMODEL_H
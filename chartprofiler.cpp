@@ -0,0 +1,180 @@
+﻿#include "chartprofiler.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+
+QBasicAtomicInt ChartProfiler::enabledFlag = Q_BASIC_ATOMIC_INITIALIZER(0);
+QBasicAtomicInt ChartProfiler::dataCallCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+namespace
+{
+    //以下由mutex保护。后台加载线程也会记录
+    struct ProfilerState
+    {
+        QMutex mutex;
+        QElapsedTimer clock;
+        ChartProfileFrame current; //正在记录的帧
+        QVector<ChartProfileFrame> frames; //最近的帧
+        int capacity = 120;
+    };
+
+    ProfilerState &state()
+    {
+        static ProfilerState profiler;
+        return profiler;
+    }
+
+    const int maxEventsPerFrame = 10000; //两次绘制之间的鼠标移动等可能很多，超过就不再记录
+}
+
+qint64 ChartProfileFrame::total(int phase) const
+{
+    qint64 sum = 0;
+    for(const ChartProfileEvent &event : events){
+        if(event.phase == phase)
+            sum += event.end - event.start;
+    }
+    return sum;
+}
+
+void ChartProfiler::setEnabled(bool enable)
+{
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    if(!profiler.clock.isValid())
+        profiler.clock.start();
+    if(enable && !isEnabled()){
+        //从这里开始新的一帧，丢掉以前的记录
+        profiler.frames.clear();
+        profiler.current = ChartProfileFrame();
+        profiler.current.start = profiler.clock.nsecsElapsed();
+        dataCallCount.storeRelaxed(0);
+    }
+    enabledFlag.storeRelaxed(enable ? 1 : 0);
+}
+
+const char *ChartProfiler::phaseName(int phase)
+{
+    static const char *const names[PhaseCount] = {
+        "paint","paint.layer","paint.overlay","paint.legend","indexAt","setSelection",
+        "visualRegionForSelection","loadFile","load.parse","load.append","saveFile",
+        "stream.flush"
+    };
+    return phase >= 0 && phase < PhaseCount ? names[phase] : "";
+}
+
+qint64 ChartProfiler::now()
+{
+    //计时起点在setEnabled中设置。还没开启时返回0
+    const QElapsedTimer &clock = state().clock;
+    return clock.isValid() ? clock.nsecsElapsed() : 0;
+}
+
+void ChartProfiler::record(Phase phase, qint64 start, qint64 end)
+{
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    if(profiler.current.events.size() >= maxEventsPerFrame)
+        return;
+    ChartProfileEvent event;
+    event.phase = phase;
+    event.start = start;
+    event.end = end;
+    event.thread = quintptr(QThread::currentThreadId());
+    profiler.current.events.append(event);
+}
+
+void ChartProfiler::endFrame()
+{
+    if(!isEnabled())
+        return;
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    ChartProfileFrame &frame = profiler.current;
+    frame.end = profiler.clock.nsecsElapsed();
+    frame.dataCalls = dataCallCount.fetchAndStoreRelaxed(0);
+    const qint64 nextStart = frame.end;
+    profiler.frames.append(std::move(frame));
+    while(profiler.frames.size() > profiler.capacity)
+        profiler.frames.removeFirst();
+    profiler.current = ChartProfileFrame();
+    profiler.current.start = nextStart;
+}
+
+void ChartProfiler::setFrameCapacity(int frames)
+{
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    profiler.capacity = qMax(1,frames);
+    while(profiler.frames.size() > profiler.capacity)
+        profiler.frames.removeFirst();
+}
+
+QVector<ChartProfileFrame> ChartProfiler::frames()
+{
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    return profiler.frames;
+}
+
+ChartProfileFrame ChartProfiler::lastFrame()
+{
+    ProfilerState &profiler = state();
+    QMutexLocker locker(&profiler.mutex);
+    return profiler.frames.isEmpty() ? ChartProfileFrame() : profiler.frames.last();
+}
+
+//Chrome跟踪格式：每次计时是一个完整事件(ph为X)，时间单位为微秒；每帧再加一个帧事件和data()调用次数
+bool ChartProfiler::writeTrace(const QString &fileName, QString *error)
+{
+    const QVector<ChartProfileFrame> recorded = frames();
+    QJsonArray events;
+    int index = 0;
+    for(const ChartProfileFrame &frame : recorded){
+        QJsonObject frameEvent;
+        frameEvent.insert(QStringLiteral("name"),QStringLiteral("frame %1").arg(index++));
+        frameEvent.insert(QStringLiteral("ph"),QStringLiteral("X"));
+        frameEvent.insert(QStringLiteral("ts"),frame.start / 1000.0);
+        frameEvent.insert(QStringLiteral("dur"),(frame.end - frame.start) / 1000.0);
+        frameEvent.insert(QStringLiteral("pid"),1);
+        frameEvent.insert(QStringLiteral("tid"),QStringLiteral("frames"));
+        events.append(frameEvent);
+
+        QJsonObject counter;
+        counter.insert(QStringLiteral("name"),QStringLiteral("model data() calls"));
+        counter.insert(QStringLiteral("ph"),QStringLiteral("C"));
+        counter.insert(QStringLiteral("ts"),frame.end / 1000.0);
+        counter.insert(QStringLiteral("pid"),1);
+        counter.insert(QStringLiteral("args"),QJsonObject{{QStringLiteral("calls"),frame.dataCalls}});
+        events.append(counter);
+
+        for(const ChartProfileEvent &event : frame.events){
+            QJsonObject object;
+            object.insert(QStringLiteral("name"),QString::fromLatin1(phaseName(event.phase)));
+            object.insert(QStringLiteral("ph"),QStringLiteral("X"));
+            object.insert(QStringLiteral("ts"),event.start / 1000.0);
+            object.insert(QStringLiteral("dur"),(event.end - event.start) / 1000.0);
+            object.insert(QStringLiteral("pid"),1);
+            object.insert(QStringLiteral("tid"),QString::number(event.thread));
+            events.append(object);
+        }
+    }
+
+    QFile file(fileName);
+    if(!file.open(QFile::WriteOnly)){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(QJsonObject{{QStringLiteral("traceEvents"),events}}).toJson(QJsonDocument::Compact));
+    if(!file.flush()){
+        if(error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
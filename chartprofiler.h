@@ -0,0 +1,103 @@
+﻿#ifndef CHARTPROFILER_H
+#define CHARTPROFILER_H
+
+#include <QAtomicInt>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QString;
+QT_END_NAMESPACE
+
+//一次计时：阶段、开始和结束时间(纳秒，从程序启动的计时起点算)、所在线程
+struct ChartProfileEvent
+{
+    int phase = 0;
+    qint64 start = 0;
+    qint64 end = 0;
+    quintptr thread = 0;
+};
+
+//一帧：上一次绘制结束到这一次绘制结束之间记录的所有计时，以及model()->data()的调用次数
+struct ChartProfileFrame
+{
+    qint64 start = 0;
+    qint64 end = 0;
+    int dataCalls = 0;
+    QVector<ChartProfileEvent> events;
+
+    //某个阶段在这一帧中的总耗时(纳秒)
+    qint64 total(int phase) const;
+};
+
+//热点路径的计时和计数。一直编译在程序里，默认关闭；关闭时每个计时点只多读一个原子变量
+namespace ChartProfiler
+{
+    enum Phase {
+        Paint, //PieView::paintEvent
+        PaintLayer, //圆的缓存层
+        PaintOverlay, //选中、当前和悬停的份额
+        PaintLegend, //彩条和文字
+        IndexAt,
+        Selection, //setSelection
+        SelectionRegion, //visualRegionForSelection
+        LoadFile, //从ChartLoader::load到加载完成或失败
+        LoadParse, //后台线程解析一块
+        LoadAppend, //把一批数据交给模型
+        SaveFile,
+        StreamFlush, //实时数据流一帧的更新交给模型
+        PhaseCount
+    };
+
+    extern QBasicAtomicInt enabledFlag;
+    extern QBasicAtomicInt dataCallCount;
+
+    //是否开启
+    inline bool isEnabled() { return enabledFlag.loadRelaxed() != 0; }
+    void setEnabled(bool enable);
+
+    //阶段的名称，用于显示和导出
+    const char *phaseName(int phase);
+
+    //当前时间，纳秒
+    qint64 now();
+    //记录一次计时。可以在任何线程调用
+    void record(Phase phase, qint64 start, qint64 end);
+    //模型的data()被调用一次
+    inline void countDataCall() { if(isEnabled()) dataCallCount.fetchAndAddRelaxed(1); }
+    //结束当前帧，放入最近的帧记录中
+    void endFrame();
+
+    //保留最近多少帧，默认120
+    void setFrameCapacity(int frames);
+    //最近的帧，最早的在前
+    QVector<ChartProfileFrame> frames();
+    //最近一帧。还没有记录时返回空的帧
+    ChartProfileFrame lastFrame();
+
+    //把最近的帧写成Chrome跟踪格式(chrome://tracing或Perfetto可以打开)
+    bool writeTrace(const QString &fileName, QString *error = nullptr);
+}
+
+//作用域计时：构造时记下开始时间，析构时记录。关闭时什么也不做
+class ChartProfileScope
+{
+public:
+    explicit ChartProfileScope(ChartProfiler::Phase phase, bool endsFrame = false)
+        : phase(phase), endsFrame(endsFrame), start(ChartProfiler::isEnabled() ? ChartProfiler::now() : -1) {}
+    ~ChartProfileScope()
+    {
+        if(start < 0)
+            return;
+        ChartProfiler::record(phase,start,ChartProfiler::now());
+        if(endsFrame)
+            ChartProfiler::endFrame();
+    }
+
+private:
+    Q_DISABLE_COPY(ChartProfileScope)
+    ChartProfiler::Phase phase;
+    bool endsFrame;
+    qint64 start;
+};
+
+#endif // CHARTPROFILER_H
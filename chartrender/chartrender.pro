@@ -0,0 +1,26 @@
+QT += widgets concurrent svg
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = chartrender
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../chartaggregate.cpp \
+    ../chartexport.cpp \
+    ../chartfile.cpp \
+    ../chartlabels.cpp \
+    ../chartmodel.cpp \
+    ../chartprofiler.cpp \
+    ../pieview.cpp
+
+HEADERS += \
+    ../chartaggregate.h \
+    ../chartexport.h \
+    ../chartfile.h \
+    ../chartlabels.h \
+    ../chartmodel.h \
+    ../chartprofiler.h \
+    ../pieview.h
@@ -0,0 +1,188 @@
+﻿#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QSaveFile>
+#include <QScrollBar>
+#include <QSvgGenerator>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <cstdio>
+#include "chartexport.h"
+#include "chartfile.h"
+#include "pieview.h"
+
+//一个读好的文件
+struct LoadedChart
+{
+    QString input;
+    ChartData data;
+    QString error;
+};
+
+//在线程池中读取文件，与MainWindow::loadFile使用同一套解析代码
+static LoadedChart loadChart(const QString &input)
+{
+    LoadedChart chart;
+    chart.input = input;
+    ChartLoadStats stats;
+    ChartFile::read(input,&chart.data,&stats,&chart.error);
+    return chart;
+}
+
+//把参数中的文件和目录展开成文件列表，目录取其中的.cht和.chtb文件
+static QStringList inputFiles(const QStringList &args)
+{
+    QStringList files;
+    for(const QString &arg : args){
+        const QFileInfo info(arg);
+        if(info.isDir()){
+            const QFileInfoList entries = QDir(arg).entryInfoList({QStringLiteral("*.cht"),QStringLiteral("*.chtb")},QDir::Files,QDir::Name);
+            for(const QFileInfo &entry : entries)
+                files.append(entry.filePath());
+        }else{
+            files.append(arg);
+        }
+    }
+    return files;
+}
+
+//不打开窗口，把.cht/.chtb文件批量画成PNG、SVG或PPM。
+//画图直接用PieView::paintEvent，和界面中同样大小的视图逐像素相同。读文件和PNG编码在线程池中并行，
+//控件只能在界面线程使用，所以画图本身在主线程按顺序进行。
+//放大导出(-x)或ppm格式时先取快照，再分成横条在线程池中并行画，ppm边画边写
+//用法：chartrender [-j 线程数] [-f png|svg|ppm] [-s 宽x高] [-x 放大倍数] -o 输出目录 文件或目录...
+int main(int argc, char *argv[])
+{
+    //没有指定平台时使用offscreen，不需要显示器
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM","offscreen");
+    QApplication app(argc,argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Render chart files to PNG or SVG."));
+    parser.addHelpOption();
+    const QCommandLineOption threadsOption({QStringLiteral("j"),QStringLiteral("threads")},
+                                           QStringLiteral("Worker threads (default: all cores)."),QStringLiteral("n"));
+    const QCommandLineOption formatOption({QStringLiteral("f"),QStringLiteral("format")},
+                                          QStringLiteral("Output format: png, svg or ppm."),QStringLiteral("format"),QStringLiteral("png"));
+    const QCommandLineOption sizeOption({QStringLiteral("s"),QStringLiteral("size")},
+                                        QStringLiteral("Image size, WIDTHxHEIGHT."),QStringLiteral("size"),QStringLiteral("600x320"));
+    const QCommandLineOption outputOption({QStringLiteral("o"),QStringLiteral("output")},
+                                          QStringLiteral("Output directory."),QStringLiteral("dir"),QStringLiteral("."));
+    const QCommandLineOption scaleOption({QStringLiteral("x"),QStringLiteral("scale")},
+                                         QStringLiteral("Scale factor for raster output, rendered in parallel tiles (default 1)."),QStringLiteral("factor"),QStringLiteral("1"));
+    parser.addOptions({threadsOption,formatOption,sizeOption,scaleOption,outputOption});
+    parser.addPositionalArgument(QStringLiteral("inputs"),QStringLiteral("Chart files or directories."),QStringLiteral("inputs..."));
+    parser.process(app);
+
+    const QString format = parser.value(formatOption).toLower();
+    const QStringList size = parser.value(sizeOption).split(QLatin1Char('x'));
+    const QSize imageSize(size.value(0).toInt(),size.value(1).toInt());
+    const QStringList inputs = inputFiles(parser.positionalArguments());
+    const QDir outputDir(parser.value(outputOption));
+    const double scale = parser.value(scaleOption).toDouble();
+    if((format != QLatin1String("png") && format != QLatin1String("svg") && format != QLatin1String("ppm"))
+            || imageSize.isEmpty() || inputs.isEmpty() || scale <= 0){
+        parser.showHelp(2);
+    }
+    if(!outputDir.exists() && !QDir().mkpath(outputDir.path())){
+        std::fprintf(stderr,"%s: cannot create directory\n",qPrintable(outputDir.path()));
+        return 1;
+    }
+    if(parser.isSet(threadsOption))
+        QThreadPool::globalInstance()->setMaxThreadCount(qMax(1,parser.value(threadsOption).toInt()));
+    const int threads = QThreadPool::globalInstance()->maxThreadCount();
+
+    //视图只有视口，没有边框和滚动条，视口的大小就是图片大小
+    ChartModel model;
+    PieView view;
+    view.setFrameShape(QFrame::NoFrame);
+    view.setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view.setModel(&model);
+    view.resize(imageSize);
+
+    QElapsedTimer timer;
+    timer.start();
+    int rendered = 0;
+    int failed = 0;
+    QList<QFuture<bool>> saves; //正在编码写出的PNG
+
+    //分批读取，限制同时在内存中的数据量。读下一批时上一批的PNG还在写
+    const int batchSize = threads * 4;
+    for(int first = 0; first < inputs.size(); first += batchSize){
+        const QStringList batch = inputs.mid(first,batchSize);
+        QFuture<LoadedChart> loaded = QtConcurrent::mapped(batch,loadChart);
+        for(int i = 0; i < batch.size(); ++i){
+            LoadedChart chart = loaded.resultAt(i); //按顺序等待，后面的文件仍在并行读取
+            if(!chart.error.isEmpty()){
+                std::fprintf(stderr,"%s: %s\n",qPrintable(chart.input),qPrintable(chart.error));
+                ++failed;
+                continue;
+            }
+            model.setChartData(std::move(chart.data));
+            view.applyPendingChanges(); //没有事件循环，模型重置的通知在这里处理
+
+            const QString output = outputDir.filePath(QFileInfo(chart.input).completeBaseName() + QLatin1Char('.') + format);
+            if(format == QLatin1String("svg")){
+                //QSvgGenerator不报告写入错误，经QSaveFile写出，打开或提交失败时算作失败
+                QSaveFile file(output);
+                bool ok = file.open(QIODevice::WriteOnly);
+                if(ok){
+                    QSvgGenerator generator;
+                    generator.setOutputDevice(&file);
+                    generator.setSize(imageSize);
+                    generator.setViewBox(QRect(QPoint(0,0),imageSize));
+                    view.viewport()->render(&generator);
+                    ok = file.commit();
+                }
+                if(!ok){
+                    std::fprintf(stderr,"%s: %s\n",qPrintable(output),qPrintable(file.errorString()));
+                    ++failed;
+                    continue;
+                }
+            }else if(format == QLatin1String("ppm") || scale != 1){
+                QString error;
+                //png放大后太大时ChartExport拒绝，不整张分配
+                if(!ChartExport::write(view.exportScene(scale),scale,output,&error)){
+                    std::fprintf(stderr,"%s: %s\n",qPrintable(output),qPrintable(error));
+                    ++failed;
+                    continue;
+                }
+            }else{
+                //与ChartExport::write相同的上限，超过时不分配
+                QImage image;
+                if(qint64(imageSize.width()) * imageSize.height() * 4 <= ChartExport::maxImageBytes)
+                    image = QImage(imageSize,QImage::Format_ARGB32_Premultiplied);
+                if(image.isNull()){
+                    std::fprintf(stderr,"%s: image too large, use -f ppm\n",qPrintable(output));
+                    ++failed;
+                    continue;
+                }
+                image.fill(Qt::transparent);
+                view.viewport()->render(&image);
+                saves.append(QtConcurrent::run([image,output]{
+                    if(image.save(output,"PNG"))
+                        return true;
+                    std::fprintf(stderr,"%s: cannot write\n",qPrintable(output));
+                    return false;
+                }));
+            }
+            ++rendered;
+        }
+    }
+    model.setChartData(ChartData());
+
+    for(QFuture<bool> &save : saves){
+        if(!save.result())
+            ++failed;
+    }
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    std::printf("%d charts, %d failed, %d threads, %.2f s, %.1f charts/s\n",rendered,failed,threads,seconds,rendered / seconds);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+﻿#include "chartsaver.h"
+#include "chartprofiler.h"
+#include <QMutex>
+#include <QThread>
+
+//一次保存任务。后台线程写入，界面线程读取
+struct ChartSaveJob
+{
+    QString fileName;
+    ChartData data; //快照。标签字典与模型共享，模型添加标签时才各自复制。只有后台线程使用
+    int totalRows = 0;
+    QAtomicInt canceled; //界面线程设置，后台线程每写完一块检查一次
+    QAtomicInt rowsWritten;
+
+    //以下由mutex保护
+    QMutex mutex;
+    bool done = false;
+    bool ok = false;
+    QString error;
+};
+
+//后台线程：写出快照
+static void runJob(const QSharedPointer<ChartSaveJob> &job)
+{
+    QString error;
+    bool ok;
+    {
+        ChartProfileScope profile(ChartProfiler::SaveFile);
+        ok = ChartFile::write(job->fileName,job->data,&error,[&job](int rows){
+            job->rowsWritten.storeRelease(rows);
+            return !job->canceled.loadAcquire();
+        });
+    }
+    job->data = ChartData(); //快照用完就释放，不必等界面线程
+    QMutexLocker locker(&job->mutex);
+    job->ok = ok;
+    job->error = error;
+    job->done = true;
+}
+
+ChartSaver::ChartSaver(QObject *parent):QObject(parent)
+{
+    pollTimer.setInterval(100);
+    connect(&pollTimer,&QTimer::timeout,this,&ChartSaver::poll);
+}
+
+ChartSaver::~ChartSaver()
+{
+    //窗口正在析构，不再发出信号
+    blockSignals(true);
+    cancel();
+}
+
+//开始保存
+bool ChartSaver::save(const QString &fileName, const ChartData &snapshot)
+{
+    if(job)
+        return false;
+
+    job.reset(new ChartSaveJob);
+    job->fileName = fileName;
+    job->data = snapshot;
+    job->totalRows = snapshot.size();
+
+    QSharedPointer<ChartSaveJob> running = job;
+    thread = QThread::create([running]{ runJob(running); });
+    thread->start();
+    pollTimer.start();
+    emit progress(0,snapshot.size());
+    return true;
+}
+
+//取消。后台线程每写完一块就检查一次，临时文件被丢弃
+void ChartSaver::cancel()
+{
+    if(!job)
+        return;
+
+    job->canceled.storeRelease(1);
+    poll(); //等待线程结束并发出结果
+}
+
+bool ChartSaver::isSaving() const
+{
+    return !job.isNull();
+}
+
+//报告进度。后台线程结束后发出结果
+void ChartSaver::poll()
+{
+    if(!job)
+        return;
+
+    bool done;
+    {
+        QMutexLocker locker(&job->mutex);
+        done = job->done;
+    }
+    if(!done && !job->canceled.loadAcquire()){
+        emit progress(job->rowsWritten.loadAcquire(),job->totalRows);
+        return;
+    }
+
+    pollTimer.stop();
+    if(thread){
+        thread->wait();
+        delete thread;
+        thread = nullptr;
+    }
+    const QSharedPointer<ChartSaveJob> finishedJob = job;
+    job.reset();
+    if(finishedJob->ok)
+        emit finished(finishedJob->fileName,finishedJob->totalRows);
+    else
+        emit failed(finishedJob->fileName,finishedJob->error);
+}
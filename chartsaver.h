@@ -0,0 +1,49 @@
+﻿#ifndef CHARTSAVER_H
+#define CHARTSAVER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include "chartfile.h"
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+struct ChartSaveJob;
+
+//在后台线程保存图表文件。保存的是开始时的数据快照，保存期间界面和模型照常可以编辑。
+//文件先写到临时文件，写完才替换目标文件，中途失败或取消时目标文件不变
+class ChartSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    ChartSaver(QObject *parent = nullptr);
+    //取消正在进行的保存并等待后台线程结束
+    ~ChartSaver();
+
+    //开始保存快照。正在保存时返回false，不会打断上一次保存
+    bool save(const QString &fileName, const ChartData &snapshot);
+    //取消正在进行的保存，目标文件保持原样
+    void cancel();
+    //是否正在保存
+    bool isSaving() const;
+
+signals:
+    //已写出的行数和总行数
+    void progress(int rowsWritten, int totalRows);
+    //保存完成
+    void finished(const QString &fileName, int rows);
+    //保存失败或被取消
+    void failed(const QString &fileName, const QString &error);
+
+private:
+    //定时器：报告进度，后台线程结束后发出结果
+    void poll();
+
+    QSharedPointer<ChartSaveJob> job; //当前的保存任务，后台线程也持有一份
+    QThread *thread = nullptr; //当前任务的后台线程
+    QTimer pollTimer;
+};
+
+#endif // CHARTSAVER_H
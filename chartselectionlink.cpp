@@ -0,0 +1,104 @@
+﻿#include "chartselectionlink.h"
+#include <QAbstractProxyModel>
+
+ChartSelectionLink::ChartSelectionLink(QItemSelectionModel *source, QAbstractProxyModel *proxy, QObject *parent)
+    :QObject(parent),source(source),proxy(proxy)
+{
+    //先于选择模型连接代理的结构变化信号，选择模型因删除行、重置发出的取消选择到来时已经在变化中
+    connect(proxy,&QAbstractItemModel::rowsAboutToBeRemoved,this,&ChartSelectionLink::beginProxyChange);
+    connect(proxy,&QAbstractItemModel::rowsRemoved,this,&ChartSelectionLink::endProxyChange);
+    connect(proxy,&QAbstractItemModel::rowsAboutToBeMoved,this,&ChartSelectionLink::beginProxyChange);
+    connect(proxy,&QAbstractItemModel::rowsMoved,this,&ChartSelectionLink::endProxyChange);
+    connect(proxy,&QAbstractItemModel::layoutAboutToBeChanged,this,&ChartSelectionLink::beginProxyChange);
+    connect(proxy,&QAbstractItemModel::layoutChanged,this,&ChartSelectionLink::endProxyChange);
+    connect(proxy,&QAbstractItemModel::modelAboutToBeReset,this,&ChartSelectionLink::beginProxyChange);
+    connect(proxy,&QAbstractItemModel::modelReset,this,&ChartSelectionLink::endProxyChange);
+    //新插入的代理行可能对应已经选中的源行
+    connect(proxy,&QAbstractItemModel::rowsInserted,this,&ChartSelectionLink::scheduleSync);
+    proxySelection = new QItemSelectionModel(proxy,this);
+
+    connect(source,&QItemSelectionModel::selectionChanged,this,&ChartSelectionLink::sourceSelectionChanged);
+    connect(source,&QItemSelectionModel::currentChanged,this,&ChartSelectionLink::sourceCurrentChanged);
+    connect(proxySelection,&QItemSelectionModel::selectionChanged,this,&ChartSelectionLink::proxySelectionChanged);
+    connect(proxySelection,&QItemSelectionModel::currentChanged,this,&ChartSelectionLink::proxyCurrentChanged);
+    syncFromSource();
+}
+
+void ChartSelectionLink::beginProxyChange()
+{
+    changing = true;
+}
+
+//变化完成的通知中选择模型也可能发出选择变化，重新映射之前一直不同步回源
+void ChartSelectionLink::endProxyChange()
+{
+    scheduleSync();
+}
+
+void ChartSelectionLink::sourceSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    if(syncing || changing || !linked())
+        return;
+    syncing = true;
+    proxySelection->select(proxy->mapSelectionFromSource(deselected),QItemSelectionModel::Deselect);
+    proxySelection->select(proxy->mapSelectionFromSource(selected),QItemSelectionModel::Select);
+    syncing = false;
+}
+
+//只同步变化的部分：代理中看不到的源选择(比如"其他"里的行)保持不变
+void ChartSelectionLink::proxySelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    if(syncing || changing || !linked())
+        return;
+    syncing = true;
+    source->select(proxy->mapSelectionToSource(deselected),QItemSelectionModel::Deselect);
+    source->select(proxy->mapSelectionToSource(selected),QItemSelectionModel::Select);
+    syncing = false;
+}
+
+void ChartSelectionLink::sourceCurrentChanged(const QModelIndex &current)
+{
+    if(syncing || changing || !linked())
+        return;
+    syncing = true;
+    proxySelection->setCurrentIndex(proxy->mapFromSource(current),QItemSelectionModel::NoUpdate);
+    syncing = false;
+}
+
+//代理中没有对应源项的行(分组、"其他")成为当前项时，源的当前项不变
+void ChartSelectionLink::proxyCurrentChanged(const QModelIndex &current)
+{
+    if(syncing || changing || !linked())
+        return;
+    const QModelIndex sourceCurrent = proxy->mapToSource(current);
+    if(!sourceCurrent.isValid())
+        return;
+    syncing = true;
+    source->setCurrentIndex(sourceCurrent,QItemSelectionModel::NoUpdate);
+    syncing = false;
+}
+
+void ChartSelectionLink::scheduleSync()
+{
+    if(syncScheduled)
+        return;
+    syncScheduled = true;
+    QMetaObject::invokeMethod(this,&ChartSelectionLink::syncFromSource,Qt::QueuedConnection);
+}
+
+void ChartSelectionLink::syncFromSource()
+{
+    syncScheduled = false;
+    changing = false;
+    if(!linked())
+        return;
+    syncing = true;
+    proxySelection->select(proxy->mapSelectionFromSource(source->selection()),QItemSelectionModel::ClearAndSelect);
+    proxySelection->setCurrentIndex(proxy->mapFromSource(source->currentIndex()),QItemSelectionModel::NoUpdate);
+    syncing = false;
+}
+
+bool ChartSelectionLink::linked() const
+{
+    return source && proxy && proxy->sourceModel() && proxy->sourceModel() == source->model();
+}
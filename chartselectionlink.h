@@ -0,0 +1,45 @@
+﻿#ifndef CHARTSELECTIONLINK_H
+#define CHARTSELECTIONLINK_H
+
+#include <QItemSelectionModel>
+#include <QPointer>
+
+class QAbstractProxyModel;
+
+//把源模型上的选择和代理模型上的选择连起来，给接在代理模型上的视图用(圆只显示前N行、旭日图)。
+//代理有自己的一个选择模型，一直使用，不随开关重建。两边的选择和当前项变化经代理映射后同步到另一边，
+//以源模型上的选择为准：代理删除行、重置时选择模型自己取消的选择不同步回去，变化完成后从源选择重新映射
+class ChartSelectionLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    ChartSelectionLink(QItemSelectionModel *source, QAbstractProxyModel *proxy, QObject *parent = nullptr);
+
+    //代理模型上的选择模型，设置给接在代理上的视图
+    QItemSelectionModel *proxySelectionModel() const { return proxySelection; }
+
+private:
+    //代理的结构开始变化和变化完成
+    void beginProxyChange();
+    void endProxyChange();
+    //按变化量同步选择，当前项直接映射
+    void sourceSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
+    void proxySelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
+    void sourceCurrentChanged(const QModelIndex &current);
+    void proxyCurrentChanged(const QModelIndex &current);
+    //从源选择整个重新映射。结构变化完成后合并到一次，在事件循环中进行
+    void scheduleSync();
+    void syncFromSource();
+    //代理当前接在源选择所在的模型上
+    bool linked() const;
+
+    QPointer<QItemSelectionModel> source;
+    QPointer<QAbstractProxyModel> proxy;
+    QItemSelectionModel *proxySelection = nullptr;
+    bool syncing = false; //正在同步，另一边的通知不再传回
+    bool changing = false; //代理结构正在变化，到重新映射时结束
+    bool syncScheduled = false;
+};
+
+#endif // CHARTSELECTIONLINK_H
@@ -0,0 +1,172 @@
+﻿#include "chartstream.h"
+#include "chartprofiler.h"
+#include <QGuiApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QScreen>
+#include <cstring>
+
+//一行最长的字节数。超过的连接被认为出错，直接断开
+static const int maxLineLength = 4096;
+
+ChartStreamSource::ChartStreamSource(ChartModel *model, QObject *parent):QObject(parent),model(model)
+{
+    //按屏幕刷新率提交，没有屏幕信息时按60Hz
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    const qreal rate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60;
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(qMax(1,int(1000 / rate)));
+    connect(&flushTimer,&QTimer::timeout,this,&ChartStreamSource::flush);
+}
+
+ChartStreamSource::~ChartStreamSource()
+{
+    //窗口正在析构，不再发出信号
+    blockSignals(true);
+    close();
+}
+
+//开始监听
+bool ChartStreamSource::listen(const QString &name, QString *error)
+{
+    close();
+    server = new QLocalServer(this);
+    QLocalServer::removeServer(name);
+    if(!server->listen(name)){
+        if(error)
+            *error = server->errorString();
+        delete server;
+        server = nullptr;
+        return false;
+    }
+    connect(server,&QLocalServer::newConnection,this,&ChartStreamSource::acceptConnections);
+    messages = dropped = rejected = 0;
+    return true;
+}
+
+//停止监听。已经收到的更新先提交
+void ChartStreamSource::close()
+{
+    if(!server)
+        return;
+    for(auto it = partialLines.cbegin(); it != partialLines.cend(); ++it){
+        it.key()->disconnect(this);
+        it.key()->abort();
+        it.key()->deleteLater();
+    }
+    partialLines.clear();
+    delete server;
+    server = nullptr;
+    flushTimer.stop();
+    flush();
+}
+
+bool ChartStreamSource::isListening() const
+{
+    return server != nullptr;
+}
+
+//新的连接
+void ChartStreamSource::acceptConnections()
+{
+    while(QLocalSocket *socket = server->nextPendingConnection()){
+        partialLines.insert(socket,QByteArray());
+        connect(socket,&QLocalSocket::readyRead,this,[this,socket]{ readClient(socket); });
+        connect(socket,&QLocalSocket::disconnected,this,[this,socket]{
+            readClient(socket); //断开前最后收到的数据
+            partialLines.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+//读取连接上所有已到达的数据，按行解析。最后不完整的一行留到下次
+void ChartStreamSource::readClient(QLocalSocket *socket)
+{
+    auto it = partialLines.find(socket);
+    if(it == partialLines.end())
+        return;
+
+    QByteArray data = it.value();
+    data += socket->readAll();
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    while(const char *newline = static_cast<const char *>(std::memchr(p,'\n',size_t(end - p)))){
+        parseLine(p,newline);
+        p = newline + 1;
+    }
+
+    if(end - p > maxLineLength){
+        //没有换行符的超长数据，不是合法的数据流
+        ++dropped;
+        partialLines.erase(it);
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+    it.value() = QByteArray(p,int(end - p));
+}
+
+//解析"标签,数值[,颜色]"。同一标签的更新只保留最新的一条
+void ChartStreamSource::parseLine(const char *begin, const char *end)
+{
+    if(end > begin && end[-1] == '\r')
+        --end;
+    if(end == begin)
+        return; //空行
+    ++messages;
+
+    const char *comma = static_cast<const char *>(std::memchr(begin,',',size_t(end - begin)));
+    if(!comma || comma == begin){
+        ++dropped;
+        return;
+    }
+    const char *valueEnd = static_cast<const char *>(std::memchr(comma + 1,',',size_t(end - comma - 1)));
+    if(!valueEnd)
+        valueEnd = end;
+
+    bool ok = false;
+    const double value = QByteArray::fromRawData(comma + 1,int(valueEnd - comma - 1)).toDouble(&ok);
+    if(!ok){
+        ++dropped;
+        return;
+    }
+    QRgb rgb = 0; //0表示不改颜色
+    if(valueEnd < end){
+        const QColor color(QLatin1String(valueEnd + 1,int(end - valueEnd - 1)));
+        if(!color.isValid()){
+            ++dropped;
+            return;
+        }
+        rgb = color.rgb();
+    }
+
+    const QString label = QString::fromUtf8(begin,int(comma - begin));
+    //pending中的标签不重复，标签在字典中的编号就是它所在的行
+    const int row = pending.labels.find(label);
+    if(row >= 0){
+        pending.values[size_t(row)] = value;
+        if(rgb)
+            pending.colors[size_t(row)] = rgb;
+    }else{
+        if(pending.size() >= maxPendingLabels){
+            ++dropped;
+            return;
+        }
+        pending.append(label,value,rgb);
+    }
+    if(!flushTimer.isActive())
+        flushTimer.start();
+}
+
+//把这一帧收到的更新一次交给模型
+void ChartStreamSource::flush()
+{
+    if(pending.size() > 0){
+        ChartProfileScope profile(ChartProfiler::StreamFlush);
+        rejected += model->upsertChartData(pending,maxRows);
+        pending.clear();
+    }
+    emit statistics(messages,dropped,rejected);
+}
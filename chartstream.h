@@ -0,0 +1,61 @@
+﻿#ifndef CHARTSTREAM_H
+#define CHARTSTREAM_H
+
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include "chartmodel.h"
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+class QLocalSocket;
+QT_END_NAMESPACE
+
+//实时数据流：在本地套接字(Windows上为命名管道)上接收"标签,数值[,#rrggbb]"的更新，每行一条。
+//收到的更新按标签合并，同一标签只保留最新的一条，按屏幕刷新的节奏一次交给模型，
+//而不是每条消息setData一次。待提交的更新按标签数量限制；模型的行数(也就是标签字典的大小)也有上限，
+//达到上限后新标签的更新被丢弃，已有标签照常更新，内存不会无限增长
+class ChartStreamSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    ChartStreamSource(ChartModel *model, QObject *parent = nullptr);
+    ~ChartStreamSource();
+
+    //开始监听。name为服务器名，同名的旧服务器(上次异常退出留下的)会先被删除
+    bool listen(const QString &name, QString *error = nullptr);
+    //停止监听并断开所有连接，没有提交的更新直接提交
+    void close();
+    bool isListening() const;
+
+    //待提交更新中最多的标签数，超过后新标签的更新被丢弃
+    void setMaxPendingLabels(int labels) { maxPendingLabels = labels; }
+    //模型最多的行数，达到后不再追加新标签
+    void setMaxRows(int rows) { maxRows = rows; }
+
+signals:
+    //一次提交之后：累计收到的消息数，累计丢弃的消息数(格式错误或超过待提交的限制)，
+    //累计因模型行数达到上限而丢弃的新标签数
+    void statistics(qint64 messages, qint64 dropped, qint64 rejected);
+
+private:
+    void acceptConnections(); //新的连接
+    void readClient(QLocalSocket *socket); //读取连接上的数据
+    void parseLine(const char *begin, const char *end); //解析一行，放入待提交的更新
+    void flush(); //把待提交的更新交给模型
+
+    ChartModel *model = nullptr;
+    QLocalServer *server = nullptr;
+    QHash<QLocalSocket *, QByteArray> partialLines; //每个连接上还没收到换行符的半行
+    QTimer flushTimer; //有更新时启动，一帧后提交
+
+    ChartData pending; //待提交的更新
+    int maxPendingLabels = 1000000;
+    int maxRows = 1000000;
+    qint64 messages = 0;
+    qint64 dropped = 0;
+    qint64 rejected = 0;
+};
+
+#endif // CHARTSTREAM_H
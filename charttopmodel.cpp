@@ -0,0 +1,418 @@
+﻿#include "charttopmodel.h"
+#include "chartmodel.h"
+#include <QItemSelection>
+#include <algorithm>
+#pragma execution_character_set("utf-8")
+
+ChartTopModel::ChartTopModel(QObject *parent):QAbstractProxyModel(parent),otherLabel(tr("其他"))
+{
+}
+
+void ChartTopModel::setSourceModel(QAbstractItemModel *model)
+{
+    beginResetModel();
+    if(QAbstractItemModel *old = sourceModel())
+        disconnect(old,nullptr,this,nullptr);
+    QAbstractProxyModel::setSourceModel(model);
+    chartModel = qobject_cast<ChartModel *>(model);
+    if(model){
+        connect(model,&QAbstractItemModel::dataChanged,this,&ChartTopModel::sourceDataChanged);
+        connect(model,&QAbstractItemModel::rowsAboutToBeInserted,this,&ChartTopModel::sourceRowsAboutToBeInserted);
+        connect(model,&QAbstractItemModel::rowsInserted,this,&ChartTopModel::sourceRowsInserted);
+        connect(model,&QAbstractItemModel::rowsAboutToBeRemoved,this,&ChartTopModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::rowsRemoved,this,&ChartTopModel::endSourceReset);
+        connect(model,&QAbstractItemModel::rowsAboutToBeMoved,this,&ChartTopModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::rowsMoved,this,&ChartTopModel::endSourceReset);
+        connect(model,&QAbstractItemModel::layoutAboutToBeChanged,this,&ChartTopModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::layoutChanged,this,&ChartTopModel::endSourceReset);
+        connect(model,&QAbstractItemModel::modelAboutToBeReset,this,&ChartTopModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::modelReset,this,&ChartTopModel::endSourceReset);
+        //源模型先于代理析构时清空，不再读取它的数值数组
+        connect(model,&QObject::destroyed,this,[this]{
+            beginResetModel();
+            chartModel = nullptr;
+            rebuild();
+            endResetModel();
+        });
+    }
+    resetting = false;
+    rebuild();
+    endResetModel();
+}
+
+//前N行的N，改变后重建
+void ChartTopModel::setLimit(int count)
+{
+    count = qMax(0,count);
+    if(count == topLimit)
+        return;
+    beginResetModel();
+    topLimit = count;
+    rebuild();
+    endResetModel();
+}
+
+void ChartTopModel::setOtherLabel(const QString &label)
+{
+    otherLabel = label;
+    const int row = otherRow();
+    if(row >= 0)
+        emit dataChanged(index(row,0),index(row,0),{Qt::DisplayRole,Qt::EditRole});
+}
+
+void ChartTopModel::setOtherColor(const QColor &color)
+{
+    otherColor = color;
+    const int row = otherRow();
+    if(row >= 0)
+        emit dataChanged(index(row,0),index(row,0),{Qt::DecorationRole});
+}
+
+QModelIndex ChartTopModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if(parent.isValid() || row < 0 || row >= rowCount() || column < 0 || column >= columnCount())
+        return QModelIndex();
+    return createIndex(row,column);
+}
+
+QModelIndex ChartTopModel::parent(const QModelIndex &) const
+{
+    return QModelIndex();
+}
+
+int ChartTopModel::rowCount(const QModelIndex &parent) const
+{
+    if(parent.isValid())
+        return 0;
+    return topRows.size() + (otherRow() >= 0 ? 1 : 0);
+}
+
+int ChartTopModel::columnCount(const QModelIndex &parent) const
+{
+    if(parent.isValid() || !sourceModel())
+        return 0;
+    return sourceModel()->columnCount();
+}
+
+QModelIndex ChartTopModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if(!proxyIndex.isValid() || !sourceModel() || proxyIndex.row() >= topRows.size())
+        return QModelIndex();
+    return sourceModel()->index(topRows.at(proxyIndex.row()),proxyIndex.column());
+}
+
+QModelIndex ChartTopModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if(!sourceIndex.isValid() || sourceIndex.parent().isValid())
+        return QModelIndex();
+    const int position = topPosition(sourceIndex.row());
+    if(position < 0)
+        return QModelIndex();
+    return index(position,sourceIndex.column());
+}
+
+QItemSelection ChartTopModel::mapSelectionFromSource(const QItemSelection &sourceSelection) const
+{
+    QItemSelection selection;
+    const int right = columnCount() - 1;
+    for(const QItemSelectionRange &range : sourceSelection){
+        if(range.parent().isValid() || range.left() > right)
+            continue;
+        const int from = int(std::lower_bound(topRows.cbegin(),topRows.cend(),range.top()) - topRows.cbegin());
+        const int to = int(std::upper_bound(topRows.cbegin(),topRows.cend(),range.bottom()) - topRows.cbegin()) - 1;
+        if(from <= to)
+            selection.append(QItemSelectionRange(index(from,range.left()),index(to,qMin(range.right(),right))));
+    }
+    return selection;
+}
+
+QVariant ChartTopModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid())
+        return QVariant();
+    if(index.row() < topRows.size())
+        return QAbstractProxyModel::data(index,role);
+
+    //"其他"行
+    switch (index.column()) {
+    case 0:
+        if(role == Qt::DisplayRole || role == Qt::EditRole)
+            return otherLabel;
+        if(role == Qt::DecorationRole)
+            return otherColor;
+        break;
+    case 1:
+        if(role == Qt::DisplayRole || role == Qt::EditRole)
+            return otherSum;
+        break;
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ChartTopModel::flags(const QModelIndex &index) const
+{
+    if(index.isValid() && index.row() >= topRows.size())
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+    return QAbstractProxyModel::flags(index);
+}
+
+QVariant ChartTopModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(!sourceModel())
+        return QVariant();
+    if(orientation == Qt::Horizontal)
+        return sourceModel()->headerData(section,orientation,role);
+    if(section < 0 || section >= topRows.size())
+        return QVariant();
+    return sourceModel()->headerData(topRows.at(section),orientation,role);
+}
+
+bool ChartTopModel::hasChildren(const QModelIndex &parent) const
+{
+    return !parent.isValid() && rowCount() > 0;
+}
+
+//数值变化：前N行以外的行超过前N行的最小值时换进来，前N行中的行低于外面的最大值时换出去。
+//其余只转发dataChanged，"其他"的数值按变化量修正
+void ChartTopModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if(resetting || !topLeft.isValid() || topLeft.parent().isValid())
+        return;
+    const int first = topLeft.row();
+    const int last = qMin(bottomRight.row(),values.size() - 1);
+    const bool valueChanged = topLeft.column() <= 1 && bottomRight.column() >= 1
+            && (roles.isEmpty() || roles.contains(Qt::DisplayRole) || roles.contains(Qt::EditRole));
+
+    bool otherChanged = false;
+    int scans = 0; //顺序查找外面最大值的次数
+    for(int row = first; valueChanged && row <= last; ++row){
+        const double value = sourceValue(row);
+        const double oldValue = values.at(row);
+        if(value == oldValue)
+            continue;
+        values[row] = value;
+
+        if(topPosition(row) < 0){
+            otherSum += value - oldValue;
+            otherChanged = true;
+            outsideBound = qMax(outsideBound,value);
+            const int lowest = minTopRow();
+            if(lowest >= 0 && value > values.at(lowest))
+                swapTop(lowest,row);
+            continue;
+        }
+
+        if(value < oldValue || row == minRow)
+            minRow = -1;
+        //变小后仍不低于外面的上界，不用查找
+        if(value < oldValue && value < outsideBound){
+            //一批中有很多行跨过边界时，重新部分选择比逐行查找快
+            if(++scans > 8){
+                beginResetModel();
+                rebuild();
+                endResetModel();
+                return;
+            }
+            const int highest = maxOutsideRow();
+            if(highest >= 0 && values.at(highest) > value){
+                swapTop(row,highest);
+                otherChanged = true;
+            }
+        }
+    }
+
+    //范围内仍在前N行中的项
+    const int from = int(std::lower_bound(topRows.cbegin(),topRows.cend(),first) - topRows.cbegin());
+    const int to = int(std::upper_bound(topRows.cbegin(),topRows.cend(),bottomRight.row()) - topRows.cbegin()) - 1;
+    const int right = qMin(bottomRight.column(),columnCount() - 1);
+    if(from <= to && topLeft.column() <= right)
+        emit dataChanged(index(from,topLeft.column()),index(to,right),roles);
+    const int other = otherRow();
+    if(otherChanged && other >= 0 && columnCount() > 1)
+        emit dataChanged(index(other,1),index(other,1),{Qt::DisplayRole,Qt::EditRole});
+}
+
+//插在中间时行号都变了，重建。追加在末尾时增量处理
+void ChartTopModel::sourceRowsAboutToBeInserted(const QModelIndex &parent, int start, int)
+{
+    if(!parent.isValid() && start != values.size())
+        beginSourceReset();
+}
+
+//末尾追加的一批行：在原来的前N行和新行中一次部分选择出新的前N行，与批的大小成线性。
+//离开的原有行逐段删除，进入的新行行号最大，一次插在前N行末尾，"其他"最后修正一次
+void ChartTopModel::sourceRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    if(parent.isValid())
+        return;
+    if(resetting){
+        endSourceReset();
+        return;
+    }
+
+    QVector<int> candidates = topRows;
+    candidates.reserve(topRows.size() + end - start + 1);
+    for(int row = start; row <= end; ++row){
+        values.append(sourceValue(row));
+        candidates.append(row);
+    }
+    //数值相同时行号小的优先，原有的行不会被同值的新行换掉
+    const int count = qMin(topLimit,candidates.size());
+    if(count < candidates.size()){
+        std::nth_element(candidates.begin(),candidates.begin() + count,candidates.end(),[this](int a, int b){
+            return values.at(a) > values.at(b) || (values.at(a) == values.at(b) && a < b);
+        });
+    }
+    //落选的行，无论原有的还是新的，都算进"其他"
+    const bool otherChanged = count < candidates.size();
+    for(int i = count; i < candidates.size(); ++i){
+        const double value = values.at(candidates.at(i));
+        otherSum += value;
+        outsideBound = qMax(outsideBound,value);
+    }
+    candidates.resize(count);
+    std::sort(candidates.begin(),candidates.end());
+
+    //candidates中start以前的是留下的原有行，是topRows的子序列。从后往前删除不在其中的各段
+    const int kept = int(std::lower_bound(candidates.cbegin(),candidates.cend(),start) - candidates.cbegin());
+    int next = kept - 1;
+    for(int position = topRows.size() - 1; position >= 0;){
+        if(next >= 0 && candidates.at(next) == topRows.at(position)){
+            --next;
+            --position;
+            continue;
+        }
+        int first = position;
+        while(first > 0 && (next < 0 || candidates.at(next) != topRows.at(first - 1)))
+            --first;
+        beginRemoveRows(QModelIndex(),first,position);
+        topRows.remove(first,position - first + 1);
+        endRemoveRows();
+        position = first - 1;
+    }
+    if(kept < count){
+        beginInsertRows(QModelIndex(),topRows.size(),topRows.size() + count - kept - 1);
+        topRows += candidates.mid(kept);
+        endInsertRows();
+    }
+    minRow = -1;
+
+    //前N行以外第一次有行时加上"其他"行
+    if(!otherVisible && values.size() > topRows.size()){
+        beginInsertRows(QModelIndex(),topRows.size(),topRows.size());
+        otherVisible = true;
+        endInsertRows();
+    }else if(otherChanged && otherVisible && columnCount() > 1){
+        emit dataChanged(index(otherRow(),1),index(otherRow(),1),{Qt::DisplayRole,Qt::EditRole});
+    }
+}
+
+void ChartTopModel::beginSourceReset()
+{
+    if(resetting)
+        return;
+    resetting = true;
+    beginResetModel();
+}
+
+void ChartTopModel::endSourceReset()
+{
+    if(!resetting)
+        beginResetModel();
+    resetting = false;
+    rebuild();
+    endResetModel();
+}
+
+//部分选择：nth_element把数值最大的N行放在前面，各自内部无序，线性时间。
+//只有这N行再按行号排序
+void ChartTopModel::rebuild()
+{
+    const int rows = sourceModel() ? sourceModel()->rowCount() : 0;
+    values.resize(rows);
+    QVector<int> order(rows);
+    for(int row = 0; row < rows; ++row){
+        values[row] = sourceValue(row);
+        order[row] = row;
+    }
+
+    const int count = qMin(topLimit,rows);
+    if(count > 0 && count < rows)
+        std::nth_element(order.begin(),order.begin() + count,order.end(),[this](int a, int b){ return values.at(a) > values.at(b); });
+
+    otherSum = 0.0;
+    outsideBound = 0.0;
+    for(int i = count; i < rows; ++i){
+        const double value = values.at(order.at(i));
+        otherSum += value;
+        outsideBound = qMax(outsideBound,value);
+    }
+    order.resize(count);
+    std::sort(order.begin(),order.end());
+    topRows = std::move(order);
+    minRow = -1;
+    otherVisible = rows > count;
+}
+
+double ChartTopModel::sourceValue(int row) const
+{
+    if(chartModel)
+        return qMax(0.0,chartModel->values()[size_t(row)]);
+    return qMax(0.0,sourceModel()->index(row,1).data().toDouble());
+}
+
+int ChartTopModel::topPosition(int row) const
+{
+    const auto it = std::lower_bound(topRows.cbegin(),topRows.cend(),row);
+    return it != topRows.cend() && *it == row ? int(it - topRows.cbegin()) : -1;
+}
+
+int ChartTopModel::minTopRow() const
+{
+    if(minRow < 0 && !topRows.isEmpty()){
+        minRow = topRows.first();
+        for(int row : topRows){
+            if(values.at(row) < values.at(minRow))
+                minRow = row;
+        }
+    }
+    return minRow;
+}
+
+int ChartTopModel::maxOutsideRow()
+{
+    int best = -1;
+    int next = 0; //topRows中下一个要跳过的行
+    for(int row = 0; row < values.size(); ++row){
+        if(next < topRows.size() && topRows.at(next) == row){
+            ++next;
+            continue;
+        }
+        if(best < 0 || values.at(row) > values.at(best))
+            best = row;
+    }
+    outsideBound = best >= 0 ? values.at(best) : 0.0;
+    return best;
+}
+
+void ChartTopModel::swapTop(int leaving, int entering)
+{
+    const int from = topPosition(leaving);
+    beginRemoveRows(QModelIndex(),from,from);
+    topRows.remove(from);
+    endRemoveRows();
+
+    const int to = int(std::lower_bound(topRows.cbegin(),topRows.cend(),entering) - topRows.cbegin());
+    beginInsertRows(QModelIndex(),to,to);
+    topRows.insert(to,entering);
+    endInsertRows();
+
+    otherSum += values.at(leaving) - values.at(entering);
+    outsideBound = qMax(outsideBound,values.at(leaving));
+    minRow = -1;
+}
+
+int ChartTopModel::otherRow() const
+{
+    return otherVisible ? topRows.size() : -1;
+}
@@ -0,0 +1,89 @@
+﻿#ifndef CHARTTOPMODEL_H
+#define CHARTTOPMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QColor>
+#include <QVector>
+
+class ChartModel;
+
+//只显示数值最大的前N行，其余行合成最后一行"其他"。放在数据模型和圆之间，类别很多时只画N+1个扇区。
+//前N行按源模型的行号顺序排列，第0列为标签，第1列为数值，源模型只用顶层各行。
+//重建时用部分选择(nth_element)找出前N行，线性时间。之后数值变化增量处理：
+//只有跨过前N边界的行才删除、插入代理行，其余只发出dataChanged，"其他"的数值一直维护着
+class ChartTopModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+public:
+    ChartTopModel(QObject *parent = nullptr);
+
+    //设置源模型并重建
+    void setSourceModel(QAbstractItemModel *model) override;
+    //前N行的N，改变后重建
+    void setLimit(int count);
+    int limit() const { return topLimit; }
+    //"其他"行的标签和颜色
+    void setOtherLabel(const QString &label);
+    void setOtherColor(const QColor &color);
+    //前N行以外各行的数值之和
+    double otherValue() const { return otherSum; }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    //前N行，源模型行数更多时再加一行"其他"
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    //"其他"行没有对应的源模型项
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    //不在前N行中的源模型项返回无效索引
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    //前N行按行号有序，每个源选择范围二分出对应的一段代理行，不展开成索引列表
+    QItemSelection mapSelectionFromSource(const QItemSelection &sourceSelection) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    //"其他"行只能选择，不能编辑
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    //列与源模型相同，"其他"行没有行表头
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+
+private:
+    //源模型的通知。数值变化和末尾追加增量处理，其余变化都重建
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void sourceRowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
+    void sourceRowsInserted(const QModelIndex &parent, int start, int end);
+    //删除、移动、布局变化和重置：先开始重置，变化完成后重建
+    void beginSourceReset();
+    void endSourceReset();
+
+    //全部重读数值，部分选择出前N行。调用者负责开始和结束重置
+    void rebuild();
+    //从源模型读取一行的数值，小于0按0算
+    double sourceValue(int row) const;
+    //源模型行在前N行中的位置，不在其中返回-1。前N行按行号有序，二分查找
+    int topPosition(int row) const;
+    //前N行中数值最小的一行，缓存失效时顺序查找
+    int minTopRow() const;
+    //前N行以外数值最大的一行，顺序查找，同时更新outsideBound
+    int maxOutsideRow();
+    //leaving离开前N行，entering进入。各发出一次行删除和行插入
+    void swapTop(int leaving, int entering);
+    //"其他"行的代理行号，没有时为-1
+    int otherRow() const;
+
+    int topLimit = 10;
+    QString otherLabel;
+    QColor otherColor = QColor(Qt::lightGray);
+    //源模型是ChartModel时直接读取它的数值数组，不经过QVariant
+    const ChartModel *chartModel = nullptr;
+
+    QVector<double> values; //源模型每行数值的缓存，用来算变化量
+    QVector<int> topRows; //前N行的源模型行号，按行号递增
+    double otherSum = 0.0; //前N行以外的数值之和
+    double outsideBound = 0.0; //前N行以外数值的上界，不一定是最大值
+    mutable int minRow = -1; //前N行中数值最小的行，-1表示需要重新查找
+    bool otherVisible = false; //有"其他"行。单独记下，追加时先改前N行，最后才加"其他"行
+    bool resetting = false; //已经开始重置，等待源模型变化完成
+};
+
+#endif // CHARTTOPMODEL_H
@@ -0,0 +1,399 @@
+﻿#include "charttreemodel.h"
+#include "chartmodel.h"
+#include <QItemSelection>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+
+ChartTreeModel::ChartTreeModel(QObject *parent):QAbstractProxyModel(parent)
+{
+    rebuild();
+}
+
+void ChartTreeModel::setSourceModel(QAbstractItemModel *model)
+{
+    beginResetModel();
+    if(QAbstractItemModel *old = sourceModel())
+        disconnect(old,nullptr,this,nullptr);
+    QAbstractProxyModel::setSourceModel(model);
+    chartModel = qobject_cast<ChartModel *>(model);
+    if(model){
+        connect(model,&QAbstractItemModel::dataChanged,this,&ChartTreeModel::sourceDataChanged);
+        connect(model,&QAbstractItemModel::rowsAboutToBeInserted,this,&ChartTreeModel::sourceRowsAboutToBeInserted);
+        connect(model,&QAbstractItemModel::rowsInserted,this,&ChartTreeModel::sourceRowsInserted);
+        connect(model,&QAbstractItemModel::rowsAboutToBeRemoved,this,&ChartTreeModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::rowsRemoved,this,&ChartTreeModel::endSourceReset);
+        connect(model,&QAbstractItemModel::rowsAboutToBeMoved,this,&ChartTreeModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::rowsMoved,this,&ChartTreeModel::endSourceReset);
+        connect(model,&QAbstractItemModel::layoutAboutToBeChanged,this,&ChartTreeModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::layoutChanged,this,&ChartTreeModel::endSourceReset);
+        connect(model,&QAbstractItemModel::modelAboutToBeReset,this,&ChartTreeModel::beginSourceReset);
+        connect(model,&QAbstractItemModel::modelReset,this,&ChartTreeModel::endSourceReset);
+        //源模型先于代理析构时清空
+        connect(model,&QObject::destroyed,this,[this]{
+            beginResetModel();
+            rebuild();
+            endResetModel();
+        });
+    }
+    resetting = false;
+    rebuild();
+    endResetModel();
+}
+
+void ChartTreeModel::setSeparator(QChar separator)
+{
+    if(separator == separatorChar)
+        return;
+    beginResetModel();
+    separatorChar = separator;
+    rebuild();
+    endResetModel();
+}
+
+QModelIndex ChartTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if(row < 0 || column < 0 || column >= columnCount() || (parent.isValid() && parent.column() != 0))
+        return QModelIndex();
+    const Node &node = nodes.at(parent.isValid() ? int(parent.internalId()) : 0);
+    if(row >= node.children.size())
+        return QModelIndex();
+    return createIndex(row,column,quintptr(node.children.at(row)));
+}
+
+QModelIndex ChartTreeModel::parent(const QModelIndex &child) const
+{
+    if(!child.isValid())
+        return QModelIndex();
+    return indexForNode(nodes.at(int(child.internalId())).parent);
+}
+
+int ChartTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if(!parent.isValid())
+        return nodes.first().children.size();
+    if(parent.column() != 0)
+        return 0;
+    return nodes.at(int(parent.internalId())).children.size();
+}
+
+int ChartTreeModel::columnCount(const QModelIndex &) const
+{
+    return sourceModel() ? sourceModel()->columnCount() : 0;
+}
+
+bool ChartTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    return rowCount(parent) > 0;
+}
+
+QModelIndex ChartTreeModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if(!proxyIndex.isValid() || !sourceModel())
+        return QModelIndex();
+    const int row = nodes.at(int(proxyIndex.internalId())).sourceRow;
+    if(row < 0)
+        return QModelIndex();
+    return sourceModel()->index(row,proxyIndex.column());
+}
+
+QModelIndex ChartTreeModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if(!sourceIndex.isValid() || sourceIndex.parent().isValid() || sourceIndex.row() >= rowNodes.size())
+        return QModelIndex();
+    return indexForNode(rowNodes.at(sourceIndex.row()),sourceIndex.column());
+}
+
+QItemSelection ChartTreeModel::mapSelectionFromSource(const QItemSelection &sourceSelection) const
+{
+    QItemSelection selection;
+    const int columns = columnCount();
+    for(const QItemSelectionRange &range : sourceSelection){
+        const int right = qMin(range.right(),columns - 1);
+        if(range.parent().isValid() || range.left() > right)
+            continue;
+        const int last = qMin(range.bottom(),rowNodes.size() - 1);
+        int first = -1; //正在合并的叶子，同一父节点下行号连续
+        int count = 0;
+        for(int row = range.top(); row <= last + 1; ++row){
+            const int leaf = row <= last ? rowNodes.at(row) : -1;
+            if(first >= 0 && leaf >= 0 && nodes.at(leaf).parent == nodes.at(first).parent
+                    && nodes.at(leaf).row == nodes.at(first).row + count){
+                ++count;
+                continue;
+            }
+            if(first >= 0){
+                const QModelIndex topLeft = indexForNode(first,range.left());
+                selection.append(QItemSelectionRange(topLeft,topLeft.sibling(topLeft.row() + count - 1,right)));
+            }
+            first = leaf;
+            count = 1;
+        }
+    }
+    return selection;
+}
+
+QVariant ChartTreeModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid())
+        return QVariant();
+    const Node &node = nodes.at(int(index.internalId()));
+    const bool display = role == Qt::DisplayRole || role == Qt::EditRole;
+    if(index.column() == 0 && display)
+        return node.name;
+    if(node.sourceRow >= 0)
+        return QAbstractProxyModel::data(index,role);
+    if(index.column() == 1 && display)
+        return node.sum;
+    return QVariant();
+}
+
+bool ChartTreeModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if(!index.isValid() || nodes.at(int(index.internalId())).sourceRow < 0)
+        return false;
+    if(index.column() != 0 || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QAbstractProxyModel::setData(index,value,role);
+    QStringList path(value.toString());
+    for(int node = nodes.at(int(index.internalId())).parent; node > 0; node = nodes.at(node).parent)
+        path.prepend(nodes.at(node).name);
+    return sourceModel()->setData(mapToSource(index),path.join(separatorChar),role);
+}
+
+Qt::ItemFlags ChartTreeModel::flags(const QModelIndex &index) const
+{
+    if(!index.isValid())
+        return Qt::NoItemFlags;
+    if(nodes.at(int(index.internalId())).sourceRow < 0)
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+    return QAbstractProxyModel::flags(index);
+}
+
+QVariant ChartTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(!sourceModel() || orientation != Qt::Horizontal)
+        return QVariant();
+    return sourceModel()->headerData(section,orientation,role);
+}
+
+//标签变了要重新分组，重建。数值变化只沿叶子到根的路径修正分组的和
+void ChartTreeModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if(resetting || !topLeft.isValid() || topLeft.parent().isValid())
+        return;
+    const int first = topLeft.row();
+    const int last = qMin(bottomRight.row(),rowNodes.size() - 1);
+    const bool text = roles.isEmpty() || roles.contains(Qt::DisplayRole) || roles.contains(Qt::EditRole);
+    if(text && topLeft.column() == 0){
+        //第0列的文字变了，逐行确认，真正改名时才重建。ChartModel只比较标签编号，不切分字符串
+        for(int row = first; row <= last; ++row){
+            if(labelChanged(row)){
+                beginResetModel();
+                rebuild();
+                endResetModel();
+                return;
+            }
+        }
+    }
+
+    QHash<int,QPair<int,int>> leaves; //父节点下变化的叶子行范围
+    QHash<int,QPair<int,int>> sums; //和改变的分组
+    QSet<int> touched;
+    const bool values = text && topLeft.column() <= 1 && bottomRight.column() >= 1;
+    for(int row = first; row <= last; ++row){
+        const int leaf = rowNodes.at(row);
+        noteChanged(&leaves,nodes.at(leaf).parent,nodes.at(leaf).row);
+        if(!values)
+            continue;
+        const double delta = sourceValue(row) - nodes.at(leaf).sum;
+        if(delta == 0)
+            continue;
+        nodes[leaf].sum += delta;
+        for(int node = nodes.at(leaf).parent; node >= 0; node = nodes.at(node).parent){
+            nodes[node].sum += delta;
+            //祖先已经记下时它上面的也都记下了，只修正和
+            if(node > 0 && !touched.contains(node)){
+                touched.insert(node);
+                noteChanged(&sums,nodes.at(node).parent,nodes.at(node).row);
+            }
+        }
+    }
+
+    notifyChanged(leaves,topLeft.column(),qMin(bottomRight.column(),columnCount() - 1),roles);
+    if(columnCount() > 1)
+        notifyChanged(sums,1,1,{Qt::DisplayRole,Qt::EditRole});
+}
+
+//插在中间时行号都变了，重建。追加在末尾时增量处理
+void ChartTreeModel::sourceRowsAboutToBeInserted(const QModelIndex &parent, int start, int)
+{
+    if(!parent.isValid() && start != rowNodes.size())
+        beginSourceReset();
+}
+
+//末尾追加的行：先建好新节点，按父节点收集，再对每个父节点发出一次行插入。
+//新节点都排在各自父节点的末尾，是连续的一段；父节点的编号比子节点小，按编号顺序插入时父节点已经可见
+void ChartTreeModel::sourceRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    if(parent.isValid())
+        return;
+    if(resetting){
+        endSourceReset();
+        return;
+    }
+    QMap<int,QVector<int>> added;
+    QHash<int,QPair<int,int>> sums;
+    QVector<int> leaves;
+    leaves.reserve(end - start + 1);
+    for(int row = start; row <= end; ++row)
+        leaves.append(addSourceRow(row,&added,&sums));
+
+    for(auto it = added.cbegin(); it != added.cend(); ++it){
+        QVector<int> &children = nodes[it.key()].children;
+        beginInsertRows(indexForNode(it.key()),children.size(),children.size() + it->size() - 1);
+        children += *it;
+        endInsertRows();
+    }
+    for(int row = start; row <= end; ++row)
+        addRowNode(row,leaves.at(row - start));
+    if(columnCount() > 1)
+        notifyChanged(sums,1,1,{Qt::DisplayRole,Qt::EditRole});
+}
+
+void ChartTreeModel::beginSourceReset()
+{
+    if(resetting)
+        return;
+    resetting = true;
+    beginResetModel();
+}
+
+void ChartTreeModel::endSourceReset()
+{
+    if(!resetting)
+        beginResetModel();
+    resetting = false;
+    rebuild();
+    endResetModel();
+}
+
+void ChartTreeModel::rebuild()
+{
+    nodes.clear();
+    nodes.append(Node{-1,-1,-1,0.0,QString(),QVector<int>()});
+    rowNodes.clear();
+    rowLabelIds.clear();
+    groups.clear();
+    const int rows = sourceModel() ? sourceModel()->rowCount() : 0;
+    nodes.reserve(rows + 1);
+    rowNodes.reserve(rows);
+    for(int row = 0; row < rows; ++row)
+        addRowNode(row,addSourceRow(row,nullptr,nullptr));
+}
+
+//标签按分隔符切开，空的部分跳过。最后一部分是叶子的名称，前面的各部分是分组
+int ChartTreeModel::addSourceRow(int row, QMap<int,QVector<int>> *added, QHash<int,QPair<int,int>> *changed)
+{
+    const QString label = sourceLabel(row);
+    const QVector<QStringRef> parts = label.splitRef(separatorChar,Qt::SkipEmptyParts);
+    int parent = 0;
+    for(int i = 0; i + 1 < parts.size(); ++i){
+        const QPair<int,QString> key(parent,parts.at(i).toString());
+        auto it = groups.constFind(key);
+        if(it == groups.constEnd())
+            it = groups.insert(key,addNode(parent,key.second,-1,added));
+        parent = it.value();
+    }
+    const int leaf = addNode(parent,parts.isEmpty() ? label : parts.last().toString(),row,added);
+
+    const double value = sourceValue(row);
+    nodes[leaf].sum = value;
+    for(int node = parent; node >= 0; node = nodes.at(node).parent){
+        nodes[node].sum += value;
+        if(changed && node > 0 && value != 0)
+            noteChanged(changed,nodes.at(node).parent,nodes.at(node).row);
+    }
+    return leaf;
+}
+
+int ChartTreeModel::addNode(int parent, const QString &name, int sourceRow, QMap<int,QVector<int>> *added)
+{
+    const int node = nodes.size();
+    if(!added){
+        nodes.append(Node{parent,nodes.at(parent).children.size(),sourceRow,0.0,name,QVector<int>()});
+        nodes[parent].children.append(node);
+        return node;
+    }
+    QVector<int> &pending = (*added)[parent];
+    nodes.append(Node{parent,nodes.at(parent).children.size() + pending.size(),sourceRow,0.0,name,QVector<int>()});
+    pending.append(node);
+    return node;
+}
+
+void ChartTreeModel::addRowNode(int row, int leaf)
+{
+    rowNodes.append(leaf);
+    if(chartModel)
+        rowLabelIds.append(chartModel->labelIds()[size_t(row)]);
+}
+
+bool ChartTreeModel::labelChanged(int row) const
+{
+    if(chartModel)
+        return chartModel->labelIds()[size_t(row)] != rowLabelIds.at(row);
+    return !labelMatches(rowNodes.at(row),sourceLabel(row));
+}
+
+//从叶子往上与标签的各部分从后往前比较
+bool ChartTreeModel::labelMatches(int leaf, const QString &label) const
+{
+    const QVector<QStringRef> parts = label.splitRef(separatorChar,Qt::SkipEmptyParts);
+    if(parts.isEmpty())
+        return nodes.at(leaf).parent == 0 && nodes.at(leaf).name == label;
+    int node = leaf;
+    for(int i = parts.size() - 1; i >= 0; --i, node = nodes.at(node).parent){
+        if(node <= 0 || nodes.at(node).name != parts.at(i))
+            return false;
+    }
+    return node == 0;
+}
+
+QString ChartTreeModel::sourceLabel(int row) const
+{
+    if(chartModel)
+        return chartModel->chartData().label(row);
+    return sourceModel()->index(row,0).data().toString();
+}
+
+double ChartTreeModel::sourceValue(int row) const
+{
+    if(chartModel)
+        return qMax(0.0,chartModel->values()[size_t(row)]);
+    return qMax(0.0,sourceModel()->index(row,1).data().toDouble());
+}
+
+QModelIndex ChartTreeModel::indexForNode(int node, int column) const
+{
+    if(node <= 0)
+        return QModelIndex();
+    return createIndex(nodes.at(node).row,column,quintptr(node));
+}
+
+void ChartTreeModel::noteChanged(QHash<int,QPair<int,int>> *changed, int parent, int row)
+{
+    auto it = changed->find(parent);
+    if(it == changed->end())
+        changed->insert(parent,qMakePair(row,row));
+    else
+        *it = qMakePair(qMin(it->first,row),qMax(it->second,row));
+}
+
+void ChartTreeModel::notifyChanged(const QHash<int,QPair<int,int>> &changed, int left, int right, const QVector<int> &roles)
+{
+    if(left > right)
+        return;
+    for(auto it = changed.cbegin(); it != changed.cend(); ++it){
+        const QModelIndex parent = indexForNode(it.key());
+        emit dataChanged(index(it->first,left,parent),index(it->second,right,parent),roles);
+    }
+}
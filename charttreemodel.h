@@ -0,0 +1,99 @@
+﻿#ifndef CHARTTREEMODEL_H
+#define CHARTTREEMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QVector>
+
+class ChartModel;
+
+//按标签中的分隔符把平面的图表数据分成树，给旭日图用：标签"水果/苹果/红富士"成为"水果"下"苹果"下的叶子"红富士"。
+//源模型的每一行是一个叶子，分组按标签前缀第一次出现的顺序建立，只用源模型的顶层各行。
+//第0列为名称，叶子的第1列为源模型的数值，分组的第1列为子树数值之和(小于0按0算)。
+//叶子数值变化时只沿祖先路径修正分组的和，末尾追加的行增量插入，标签改变和其他结构变化都重建
+class ChartTreeModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+public:
+    ChartTreeModel(QObject *parent = nullptr);
+
+    //设置源模型并重建
+    void setSourceModel(QAbstractItemModel *model) override;
+    //标签中分隔各层的字符，默认为'/'，改变后重建
+    void setSeparator(QChar separator);
+    QChar separator() const { return separatorChar; }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    //只有第0列的项有子项
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    //分组没有对应的源模型项
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    //源选择逐行映射，同一分组下相邻的叶子合成一个范围，不展开成索引列表
+    QItemSelection mapSelectionFromSource(const QItemSelection &sourceSelection) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    //叶子改名只改标签的最后一部分，所在的分组不变
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    //分组只能选择，不能编辑
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    //列与源模型相同，没有行表头
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    //源模型的通知。数值变化和末尾追加增量处理，其余变化都重建
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void sourceRowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
+    void sourceRowsInserted(const QModelIndex &parent, int start, int end);
+    //删除、移动、布局变化和重置：先开始重置，变化完成后重建
+    void beginSourceReset();
+    void endSourceReset();
+
+    //按源模型全部重建。调用者负责开始和结束重置
+    void rebuild();
+    //把源模型的一行加到树中，缺少的分组一起建立，返回叶子。added不为空时新节点先按父节点收集在其中，
+    //由调用者发出行插入后再接到父节点下；changed记下和改变的分组
+    int addSourceRow(int row, QMap<int,QVector<int>> *added, QHash<int,QPair<int,int>> *changed);
+    //在parent下末尾加一个节点，返回节点号
+    int addNode(int parent, const QString &name, int sourceRow, QMap<int,QVector<int>> *added);
+    //记下源模型行对应的叶子和标签编号
+    void addRowNode(int row, int leaf);
+    //源模型一行的标签是否与建树时不同
+    bool labelChanged(int row) const;
+    //叶子的路径是否仍与标签一致
+    bool labelMatches(int leaf, const QString &label) const;
+    //从源模型读取一行的标签和数值，数值小于0按0算
+    QString sourceLabel(int row) const;
+    double sourceValue(int row) const;
+    //节点的第column列索引，根节点为无效索引
+    QModelIndex indexForNode(int node, int column = 0) const;
+    //记下改变的节点，按父节点合并成行范围；notifyChanged对每个范围发出一次dataChanged
+    static void noteChanged(QHash<int,QPair<int,int>> *changed, int parent, int row);
+    void notifyChanged(const QHash<int,QPair<int,int>> &changed, int left, int right, const QVector<int> &roles);
+
+    //节点0为根，分组的sourceRow为-1
+    struct Node
+    {
+        int parent;
+        int row; //在父节点下的行号
+        int sourceRow;
+        double sum; //子树数值之和，叶子为自己的数值
+        QString name;
+        QVector<int> children;
+    };
+    QVector<Node> nodes;
+    QVector<int> rowNodes; //源模型每行对应的叶子
+    QVector<quint32> rowLabelIds; //源模型是ChartModel时每行的标签编号，改名时编号一定变
+    QHash<QPair<int,QString>,int> groups; //(父节点,名称)对应的分组
+    QChar separatorChar = QLatin1Char('/');
+    //源模型是ChartModel时直接读取它的数据，不经过QVariant
+    QPointer<const ChartModel> chartModel;
+    bool resetting = false; //已经开始重置，等待源模型变化完成
+};
+
+#endif // CHARTTREEMODEL_H
@@ -0,0 +1,20 @@
+QT += gui concurrent
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = chtconvert
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../chartfile.cpp \
+    ../chartlabels.cpp \
+    ../chartmodel.cpp \
+    ../chartprofiler.cpp
+
+HEADERS += \
+    ../chartfile.h \
+    ../chartlabels.h \
+    ../chartmodel.h \
+    ../chartprofiler.h
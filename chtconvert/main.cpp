@@ -0,0 +1,37 @@
+﻿#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <cstdio>
+#include "chartfile.h"
+
+//在.cht文本格式和.chtb二进制格式之间转换。输出格式由输出文件的扩展名决定
+//用法：chtconvert 输入文件 输出文件
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc,argv);
+    const QStringList args = app.arguments();
+    if(args.size() != 3){
+        std::fprintf(stderr,"usage: chtconvert <input.cht|input.chtb> <output.cht|output.chtb>\n");
+        return 2;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    ChartData data;
+    ChartLoadStats stats;
+    QString error;
+    if(!ChartFile::read(args.at(1),&data,&stats,&error)){
+        std::fprintf(stderr,"%s: %s\n",qPrintable(args.at(1)),qPrintable(error));
+        return 1;
+    }
+    if(stats.malformedLines > 0)
+        std::fprintf(stderr,"%s: skipped %d malformed lines (first at line %d)\n",
+                     qPrintable(args.at(1)),stats.malformedLines,stats.firstMalformedLine);
+    const qint64 readTime = timer.restart();
+
+    if(!ChartFile::write(args.at(2),data,&error)){
+        std::fprintf(stderr,"%s: %s\n",qPrintable(args.at(2)),qPrintable(error));
+        return 1;
+    }
+    std::printf("%d rows, read %lld ms, write %lld ms\n",data.size(),readTime,timer.elapsed());
+    return 0;
+}
@@ -1,6 +1,18 @@
 ﻿#include "mainwindow.h"
 #include <QtWidgets>
+#include <QtConcurrent>
 #include <pieview.h>
+#include "sunburstview.h"
+#include "chartmodel.h"
+#include "chartfile.h"
+#include "chartloader.h"
+#include "chartsaver.h"
+#include "chartexport.h"
+#include "chartprofiler.h"
+#include "chartstream.h"
+#include "charttopmodel.h"
+#include "charttreemodel.h"
+#include "chartselectionlink.h"
 #pragma execution_character_set("utf-8")
 
 MainWindow::MainWindow(QWidget *parent):QMainWindow(parent)
@@ -11,9 +23,23 @@ MainWindow::MainWindow(QWidget *parent):QMainWindow(parent)
     openAction->setShortcuts(QKeySequence::Open); //打开文件
     QAction *saveAction = fileMenu->addAction(tr("&另存为..."));
     saveAction->setShortcuts(QKeySequence::SaveAs);
+    QAction *exportAction = fileMenu->addAction(tr("导出图片..."));
+    streamAction = fileMenu->addAction(tr("接收实时数据流"));
+    streamAction->setCheckable(true);
     QAction *quitAction = fileMenu->addAction(tr("&退出"));
     quitAction->setShortcuts(QKeySequence::Quit);
 
+    //性能统计菜单
+    QMenu *profileMenu = new QMenu(tr("&性能"),this);
+    QAction *profileAction = profileMenu->addAction(tr("显示性能统计"));
+    profileAction->setCheckable(true);
+    QAction *traceAction = profileMenu->addAction(tr("导出性能记录..."));
+
+    //视图菜单
+    QMenu *viewMenu = new QMenu(tr("&视图"),this);
+    QAction *topAction = viewMenu->addAction(tr("圆只显示最大的10项"));
+    topAction->setCheckable(true);
+
     setupModel(); //创建模型
     setupViews(); //创建视图
 
@@ -21,10 +47,55 @@ MainWindow::MainWindow(QWidget *parent):QMainWindow(parent)
     connect(openAction,&QAction::triggered,this,&MainWindow::openFile);
     //保存文件
     connect(saveAction,&QAction::triggered,this,&MainWindow::saveFile);
+    //导出图片
+    connect(exportAction,&QAction::triggered,this,&MainWindow::exportImage);
     connect(quitAction,&QAction::triggered,qApp,&QCoreApplication::quit);
+    connect(profileAction,&QAction::toggled,this,&MainWindow::setProfiling);
+    connect(traceAction,&QAction::triggered,this,&MainWindow::exportTrace);
+    connect(topAction,&QAction::toggled,this,&MainWindow::setTopOnly);
     //将菜单添加到菜单栏
     menuBar()->addMenu(fileMenu);
+    menuBar()->addMenu(viewMenu);
+    menuBar()->addMenu(profileMenu);
     statusBar(); //返回主窗口的状态栏
+
+    //加载时在状态栏右边显示进度条和取消按钮
+    loadProgress = new QProgressBar;
+    loadProgress->setRange(0,1000);
+    loadProgress->setMaximumWidth(200);
+    cancelButton = new QToolButton;
+    cancelButton->setText(tr("取消"));
+    statusBar()->addPermanentWidget(loadProgress);
+    statusBar()->addPermanentWidget(cancelButton);
+    setLoadingVisible(false);
+
+    //性能统计，开启后才显示
+    profileLabel = new QLabel;
+    profileLabel->setVisible(false);
+    statusBar()->addPermanentWidget(profileLabel);
+    profileTimer = new QTimer(this);
+    profileTimer->setInterval(250);
+    connect(profileTimer,&QTimer::timeout,this,&MainWindow::updateProfileReadout);
+
+    //后台加载文件，数据一批一批交给模型
+    loader = new ChartLoader(model,this);
+    connect(loader,&ChartLoader::progress,this,&MainWindow::loadProgressed);
+    connect(loader,&ChartLoader::finished,this,&MainWindow::loadFinished);
+    connect(loader,&ChartLoader::canceled,this,&MainWindow::loadCanceled);
+    connect(loader,&ChartLoader::failed,this,&MainWindow::loadFailed);
+    connect(cancelButton,&QToolButton::clicked,loader,&ChartLoader::cancel);
+
+    //后台保存快照，保存期间可以继续编辑
+    saver = new ChartSaver(this);
+    connect(saver,&ChartSaver::progress,this,&MainWindow::saveProgressed);
+    connect(saver,&ChartSaver::finished,this,&MainWindow::saveFinished);
+    connect(saver,&ChartSaver::failed,this,&MainWindow::saveFailed);
+
+    //实时数据流，按屏幕刷新的节奏合并更新
+    stream = new ChartStreamSource(model,this);
+    connect(stream,&ChartStreamSource::statistics,this,&MainWindow::streamStatistics);
+    connect(streamAction,&QAction::toggled,this,&MainWindow::setStreaming);
+
     loadFile(":/Charts/qtdata.cht");
     setWindowTitle(tr("图表"));
     resize(870,560);
@@ -33,66 +104,123 @@ MainWindow::MainWindow(QWidget *parent):QMainWindow(parent)
 //选择文件
 void MainWindow::openFile()
 {
-    //用户选择文件目录
-    const QString fileName = QFileDialog::getOpenFileName(this,tr("选择一个数据文件"),"*.cht");
+    //用户选择文件目录。文本格式和二进制格式都可以打开
+    const QString fileName = QFileDialog::getOpenFileName(this,tr("选择一个数据文件"),QString(),
+                                                          tr("图表文件 (*.cht *.chtb);;文本图表 (*.cht);;二进制图表 (*.chtb)"));
     if(!fileName.isEmpty())
         loadFile(fileName); //处理打开的文件
 }
 
-//保存文件
+//保存文件。扩展名为.chtb时保存为二进制格式
 void MainWindow::saveFile()
 {
-    QString fileName = QFileDialog::getSaveFileName(this,tr("保存文件为"),"","*.cht");
+    QString fileName = QFileDialog::getSaveFileName(this,tr("保存文件为"),"",tr("文本图表 (*.cht);;二进制图表 (*.chtb)"));
     if(fileName.isEmpty()) //文件无数据
         return;
 
-    QFile file(fileName);
-    //可写文本
-    if(!file.open(QFile::WriteOnly | QFile::Text))
+    //复制模型各列作为快照交给后台线程，标签数组是共享的，复制只需要一次内存拷贝
+    if(!saver->save(fileName,model->chartData()))
+        statusBar()->showMessage(tr("正在保存另一个文件，请稍后再试"),2000);
+}
+
+//把圆导出成大图。在界面线程取得快照，画图和写文件在后台，分块画图也在同一个线程池中并行。
+//ppm格式边画边写，不用整张图放在内存中
+void MainWindow::exportImage()
+{
+    PieView *pieView = qobject_cast<PieView *>(pieChart);
+    const QString fileName = QFileDialog::getSaveFileName(this,tr("导出图片"),QString(),tr("PNG图片 (*.png);;PPM图片 (*.ppm)"));
+    if(!pieView || fileName.isEmpty())
         return;
-    QTextStream stream(&file); //为读写文本提供一个方便的接口
-    for(int row = 0; row < model->rowCount(QModelIndex()); ++row){
-        QStringList pieces;
-
-        //在列表的末尾插入值
-        pieces.append(model->data(model->index(row,0,QModelIndex()),Qt::DisplayRole).toString());
-        pieces.append(model->data(model->index(row,1,QModelIndex()),Qt::DisplayRole).toString());
-        pieces.append(model->data(model->index(row,0,QModelIndex()),Qt::DecorationRole).toString());
-        //将所有字符串连接为一个字符串写入到文件
-        stream << pieces.join(',')<<"\n";
-    }
-    file.close();
-    statusBar()->showMessage(tr("保存 %1 成功").arg(fileName),2000);
+    bool ok = false;
+    const int scale = QInputDialog::getInt(this,tr("导出图片"),tr("放大倍数"),8,1,64,1,&ok);
+    if(!ok)
+        return;
+
+    const PieScene scene = pieView->exportScene(scale);
+    statusBar()->showMessage(tr("正在导出 %1").arg(fileName));
+    QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher,&QFutureWatcher<QString>::finished,this,[this,watcher,fileName]{
+        const QString error = watcher->result();
+        if(error.isEmpty())
+            statusBar()->showMessage(tr("导出 %1 成功").arg(fileName),2000);
+        else
+            statusBar()->showMessage(tr("导出 %1 失败：%2").arg(fileName,error),5000);
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run([scene,scale,fileName]{
+        QString error;
+        ChartExport::write(scene,scale,fileName,&error);
+        return error;
+    }));
+}
+
+void MainWindow::saveProgressed(int rowsWritten, int totalRows)
+{
+    const int percent = totalRows > 0 ? int(qint64(rowsWritten) * 100 / totalRows) : 0;
+    statusBar()->showMessage(tr("正在保存 %1%").arg(percent));
+}
+
+void MainWindow::saveFinished(const QString &fileName, int rows)
+{
+    statusBar()->showMessage(tr("保存 %1 成功，%2 行").arg(fileName).arg(rows),2000);
+}
+
+void MainWindow::saveFailed(const QString &fileName, const QString &error)
+{
+    statusBar()->showMessage(tr("保存 %1 失败：%2").arg(fileName,error),5000);
 }
 
 //创建模型
 void MainWindow::setupModel()
 {
-    //创建自定义数据的通用模型
-    model = new QStandardItemModel(8,2,this);
+    //按列存储标签、数值和颜色的图表模型
+    model = new ChartModel(this);
     model->setHeaderData(0, Qt::Horizontal, tr("标签"));
     model->setHeaderData(1,Qt::Horizontal,tr("数量"));
 }
 
+//换视图的模型，使用已有的选择模型。setModel为新模型建的选择模型随即删除，反复切换不会累积
+static void setViewModel(QAbstractItemView *view, QAbstractItemModel *model, QItemSelectionModel *selection)
+{
+    view->setModel(model);
+    QItemSelectionModel *created = view->selectionModel();
+    view->setSelectionModel(selection);
+    if(created != selection && created->parent() == view)
+        delete created;
+}
+
 //创建视图
 void MainWindow::setupViews()
 {
     QSplitter *splitter = new QSplitter; //拆分器
     QTableView *table = new QTableView; //默认表视图
-    pieChart = new PieView; //自定义视图，圆
+    PieView *pieView = new PieView; //自定义视图，圆
+    pieView->setHoverTracking(true); //鼠标悬停时高亮份额
+    pieChart = pieView;
+    sunburstChart = new SunburstView; //树形模型的每一层画成一圈
+    QTabWidget *charts = new QTabWidget; //两种图放在不同的页
+    charts->addTab(pieChart,tr("圆"));
+    charts->addTab(sunburstChart,tr("旭日图"));
     splitter->addWidget(table); //添加到拆分器的布局中
-    splitter->addWidget(pieChart);
+    splitter->addWidget(charts);
     //更新小部件在位置索引处的大小策略，使其具有拉伸因子。参数索引，伸展
     splitter->setStretchFactor(0,0);
     splitter->setStretchFactor(1,1);
 
     table->setModel(model); //设置显示视图的模型
     pieChart->setModel(model);
+    //旭日图接在按标签分组的树形代理上
+    treeModel = new ChartTreeModel(this);
+    treeModel->setSourceModel(model);
+    sunburstChart->setModel(treeModel);
 
     //跟踪视图中或同一模型的多个视图中所选的项。
-    QItemSelectionModel *selectionModel = new QItemSelectionModel(model);
-    table->setSelectionModel(selectionModel); //设置当前的选择模型
-    pieChart->setSelectionModel(selectionModel);
+    selections = new QItemSelectionModel(model);
+    table->setSelectionModel(selections); //设置当前的选择模型
+    pieChart->setSelectionModel(selections);
+    //旭日图的选择经过树形代理映射，与表格的选择同步
+    ChartSelectionLink *treeSelections = new ChartSelectionLink(selections,treeModel,this);
+    sunburstChart->setSelectionModel(treeSelections->proxySelectionModel());
 
     //为视图提供标题行或标题列。返回视图的水平表头
     QHeaderView *headerView = table->horizontalHeader();
@@ -103,42 +231,136 @@ void MainWindow::setupViews()
     setCentralWidget(splitter);
 }
 
-//处理打开的文件,把文件数据插入到模型中
+//处理打开的文件,在后台线程读取，数据逐步插入到模型中。正在加载的文件会被取消
 void MainWindow::loadFile(const QString &fileName)
 {
-    QFile file(fileName); //读取文件
-    //打开模式为只读文本
-    if(!file.open(QFile::ReadOnly | QFile::Text))
+    loader->load(fileName); //先取消上一次加载，再开始这一次
+    loadProgress->setValue(0);
+    setLoadingVisible(true);
+    statusBar()->showMessage(tr("正在加载 %1").arg(fileName));
+}
+
+//加载进度
+void MainWindow::loadProgressed(qint64 bytesRead, qint64 totalBytes)
+{
+    if(totalBytes > 0)
+        loadProgress->setValue(int(bytesRead * 1000 / totalBytes));
+}
+
+//加载完成。有格式错误的行时报告数量和第一处的行号
+void MainWindow::loadFinished(const QString &fileName, const ChartLoadStats &stats)
+{
+    setLoadingVisible(false);
+    if(stats.malformedLines > 0)
+        statusBar()->showMessage(tr("加载完成 %1，%2 行，跳过 %3 行格式错误的数据(第 %4 行)")
+                                 .arg(fileName).arg(stats.rows).arg(stats.malformedLines).arg(stats.firstMalformedLine),5000);
+    else
+        statusBar()->showMessage(tr("加载完成 %1").arg(fileName),2000);
+}
+
+//加载被取消，已经显示的数据保留
+void MainWindow::loadCanceled(const QString &fileName, int rows)
+{
+    setLoadingVisible(false);
+    statusBar()->showMessage(tr("已取消加载 %1，已加载 %2 行").arg(fileName).arg(rows),5000);
+}
+
+//文件打不开
+void MainWindow::loadFailed(const QString &fileName, const QString &error)
+{
+    setLoadingVisible(false);
+    statusBar()->showMessage(tr("无法打开 %1：%2").arg(fileName,error),5000);
+}
+
+//显示或隐藏进度条和取消按钮
+void MainWindow::setLoadingVisible(bool visible)
+{
+    loadProgress->setVisible(visible);
+    cancelButton->setVisible(visible);
+}
+
+//开启或关闭性能统计
+void MainWindow::setProfiling(bool enable)
+{
+    ChartProfiler::setEnabled(enable);
+    profileLabel->setVisible(enable);
+    if(enable){
+        profileLabel->clear();
+        profileTimer->start();
+    }else{
+        profileTimer->stop();
+    }
+}
+
+//状态栏显示最近一帧：绘制总时间和各部分、data()调用次数，以及这一帧中命中测试和选择的耗时
+void MainWindow::updateProfileReadout()
+{
+    const ChartProfileFrame frame = ChartProfiler::lastFrame();
+    auto ms = [&frame](int phase) { return QString::number(frame.total(phase) / 1e6,'f',2); };
+    profileLabel->setText(tr("绘制 %1 ms(圆 %2，高亮 %3，彩条 %4) | data() %5 次 | indexAt %6 ms | 选择 %7 ms | 区域 %8 ms")
+                          .arg(ms(ChartProfiler::Paint),ms(ChartProfiler::PaintLayer),ms(ChartProfiler::PaintOverlay),
+                               ms(ChartProfiler::PaintLegend))
+                          .arg(frame.dataCalls)
+                          .arg(ms(ChartProfiler::IndexAt),ms(ChartProfiler::Selection),ms(ChartProfiler::SelectionRegion)));
+}
+
+//把最近的帧导出为Chrome跟踪格式
+void MainWindow::exportTrace()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this,tr("导出性能记录"),"",tr("Chrome跟踪文件 (*.json)"));
+    if(fileName.isEmpty())
         return;
+    QString error;
+    if(!ChartProfiler::writeTrace(fileName,&error)){
+        statusBar()->showMessage(tr("导出 %1 失败：%2").arg(fileName,error),5000);
+        return;
+    }
+    statusBar()->showMessage(tr("已导出 %1").arg(fileName),2000);
+}
 
-    QTextStream stream(&file); //为读写文本提供了一个方便的接口
-
-    //从父级开始删除行
-    model->removeRows(0,model->rowCount(QModelIndex()),QModelIndex());
-    int row = 0;
-    while (!stream.atEnd()) { //没有数据要从QTextStream读取时返回true
-        //从流中读取一行文本
-        const QString line = stream.readLine();
-        if(!line.isEmpty()){
-            //插入行到模型中
-            model->insertRows(row,1,QModelIndex());
-            //在，号的地方拆分成子字符串。字段是空的在结果中不包含
-            const QStringList pieces = line.split(QLatin1Char(','),Qt::SkipEmptyParts);
-            if(pieces.size() < 3)
-                continue;
-
-            //在索引处设置值
-            model->setData(model->index(row,0,QModelIndex()),pieces.value(0));
-            model->setData(model->index(row,1,QModelIndex()),pieces.value(1));
-            //插入颜色,角色以图标的形式作为装饰呈现的数据
-            model->setData(model->index(row,0,QModelIndex()),QColor(pieces.value(2)),Qt::DecorationRole);
-            row++;
-        }
-    };
-
-    file.close();
-    //状态栏
-    statusBar()->showMessage(tr("加载完成 %1").arg(fileName),2000);
+//开始或停止接收实时数据流。服务器名为chart1，可以用chartfeed发送测试数据
+void MainWindow::setStreaming(bool enable)
+{
+    if(!enable){
+        stream->close();
+        statusBar()->showMessage(tr("已停止接收数据流"),2000);
+        return;
+    }
+    const QString name = QStringLiteral("chart1");
+    QString error;
+    if(!stream->listen(name,&error)){
+        streamAction->setChecked(false);
+        statusBar()->showMessage(tr("无法接收数据流 %1：%2").arg(name,error),5000);
+        return;
+    }
+    statusBar()->showMessage(tr("正在接收数据流 %1").arg(name));
 }
 
+//圆只显示数值最大的10项，其余合成"其他"。表格和旭日图仍然显示全部数据
+void MainWindow::setTopOnly(bool enable)
+{
+    if(!enable){
+        setViewModel(pieChart,model,selections);
+        topModel->setSourceModel(nullptr); //不用时不再跟踪模型的变化
+        return;
+    }
+    if(!topModel){
+        topModel = new ChartTopModel(this);
+        topModel->setLimit(10);
+        //代理上的选择只建一次，经代理映射与表格的选择同步
+        topSelections = new ChartSelectionLink(selections,topModel,this);
+    }
+    topModel->setSourceModel(model);
+    setViewModel(pieChart,topModel,topSelections->proxySelectionModel());
+}
 
+//数据流的统计，每次提交后更新
+void MainWindow::streamStatistics(qint64 messages, qint64 dropped, qint64 rejected)
+{
+    if(!stream->isListening())
+        return;
+    QString text = tr("数据流：已接收 %1 条，丢弃 %2 条").arg(messages).arg(dropped);
+    if(rejected > 0)
+        text += tr("，行数已达上限，新标签 %1 条未加入").arg(rejected);
+    statusBar()->showMessage(text);
+}
@@ -6,7 +6,21 @@
 QT_BEGIN_NAMESPACE //开始命名空间(避免出现重命名)
 class QAbstractItemModel; //模型标准接口，抽象
 class QAbstractItemView; //视图类基本功能，抽象
+class QAction; //菜单项
+class QItemSelectionModel; //选择模型
+class QLabel; //文字标签
+class QProgressBar; //进度条
+class QTimer; //定时器
+class QToolButton; //工具按钮
 QT_END_NAMESPACE //结束命名空间
+class ChartModel; //图表数据模型
+class ChartLoader; //后台加载文件
+class ChartSaver; //后台保存文件
+class ChartStreamSource; //实时数据流
+class ChartTopModel; //只保留最大的几项
+class ChartTreeModel; //按标签分组的树
+class ChartSelectionLink; //代理模型与表格同步选择
+struct ChartLoadStats; //加载结果统计
 
 class MainWindow : public QMainWindow
 {
@@ -17,14 +31,52 @@ public:
 private slots:
     void openFile(); //选择文件
     void saveFile(); //保存文件
+    void exportImage(); //把圆导出成大图
 
 private:
     void setupModel(); //创建模型
     void setupViews(); //创建视图
     void loadFile(const QString &path); //处理打开文件
 
-    QAbstractItemModel *model = nullptr;
+    //后台加载的进度和结果，显示在状态栏
+    void loadProgressed(qint64 bytesRead, qint64 totalBytes);
+    void loadFinished(const QString &fileName, const ChartLoadStats &stats);
+    void loadCanceled(const QString &fileName, int rows);
+    void loadFailed(const QString &fileName, const QString &error);
+    void setLoadingVisible(bool visible); //显示或隐藏进度条和取消按钮
+
+    //后台保存的进度和结果，显示在状态栏
+    void saveProgressed(int rowsWritten, int totalRows);
+    void saveFinished(const QString &fileName, int rows);
+    void saveFailed(const QString &fileName, const QString &error);
+
+    //开始或停止接收实时数据流
+    void setStreaming(bool enable);
+    void streamStatistics(qint64 messages, qint64 dropped, qint64 rejected);
+
+    //圆只显示数值最大的几项，其余合成"其他"
+    void setTopOnly(bool enable);
+
+    //性能统计：开启后状态栏显示最近一帧各阶段的耗时，可以导出最近的帧
+    void setProfiling(bool enable);
+    void updateProfileReadout();
+    void exportTrace();
+
+    ChartModel *model = nullptr;
     QAbstractItemView *pieChart = nullptr;
+    QAbstractItemView *sunburstChart = nullptr; //旭日图，接在树形代理上
+    QItemSelectionModel *selections = nullptr; //表格和图共用的选择
+    ChartTopModel *topModel = nullptr; //圆只显示最大的几项时使用，第一次开启时创建
+    ChartSelectionLink *topSelections = nullptr; //圆接在topModel上时的选择，与topModel一起创建
+    ChartTreeModel *treeModel = nullptr; //标签按'/'分层，给旭日图用
+    ChartLoader *loader = nullptr; //在后台线程读取文件
+    ChartSaver *saver = nullptr; //在后台线程保存文件
+    ChartStreamSource *stream = nullptr; //本地套接字上的实时数据
+    QAction *streamAction = nullptr; //开始/停止接收数据流
+    QProgressBar *loadProgress = nullptr; //状态栏中的加载进度
+    QToolButton *cancelButton = nullptr; //取消加载
+    QLabel *profileLabel = nullptr; //状态栏中的性能统计
+    QTimer *profileTimer = nullptr; //定时刷新性能统计
 
 };
 
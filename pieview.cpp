@@ -1,6 +1,20 @@
 ﻿#include "pieview.h"
+#include "chartaggregate.h"
+#include "chartexport.h"
+#include "chartmodel.h"
+#include "chartprofiler.h"
 #include <QtWidgets>
 #include <qdebug.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+//调试输出默认编译掉。需要时在chart1.pro中加上DEFINES += PIEVIEW_DEBUG
+#ifdef PIEVIEW_DEBUG
+#define pieDebug qDebug
+#else
+#define pieDebug QT_NO_QDEBUG_MACRO
+#endif
 
 PieView::PieView(QWidget *parent):QAbstractItemView(parent)
 {
@@ -8,6 +22,37 @@ PieView::PieView(QWidget *parent):QAbstractItemView(parent)
     //设置值为0时将隐藏滚动条。
     horizontalScrollBar()->setRange(0,0);
     verticalScrollBar()->setRange(0,0); //垂直滚动条
+    attachAggregate(); //没有模型时是一个空的汇总
+}
+
+//设置模型
+void PieView::setModel(QAbstractItemModel *model)
+{
+    QAbstractItemView::setModel(model);
+    chartModel = qobject_cast<ChartModel *>(model);
+    hoverIndex = QPersistentModelIndex();
+    attachAggregate();
+}
+
+//悬停跟踪。indexAt使用二分查找，所以每次鼠标移动都查询也不会卡
+void PieView::setHoverTracking(bool enable)
+{
+    if(hoverEnabled == enable)
+        return;
+    hoverEnabled = enable;
+    //没有按下鼠标时视口也接收鼠标移动事件
+    viewport()->setMouseTracking(enable);
+    if(!enable)
+        setHoverIndex(QModelIndex());
+}
+
+void PieView::setLevelOfDetail(bool enable)
+{
+    if(lodEnabled == enable)
+        return;
+    lodEnabled = enable;
+    pieLayerDirty = true;
+    viewport()->update();
 }
 
 //得到圆右边彩条文字的绘制范围矩形。
@@ -43,13 +88,14 @@ void PieView::scrollTo(const QModelIndex &index, QAbstractItemView::ScrollHint h
     }else if(rect.bottom() > area.bottom()){ //矩形底边y坐标
         verticalScrollBar()->setValue(verticalScrollBar()->value() + qMin(rect.bottom() - area.bottom(),rect.top() - area.top()));
     }
-    update(); //更新小部件
+    //滚动条的值改变时scrollContentsBy只重画露出的部分，这里不再整个重画
 }
 
 //返回项在视口坐标点的模型索引。也就是鼠标点击处的模型索引
 QModelIndex PieView::indexAt(const QPoint &point) const
 {
-    if(validItems == 0) //数据量
+    ChartProfileScope profile(ChartProfiler::IndexAt);
+    if(aggregate->validItems() == 0) //数据量
         return QModelIndex();
 
     //鼠标单击处的坐标位置
@@ -72,94 +118,86 @@ QModelIndex PieView::indexAt(const QPoint &point) const
         if(angle < 0)
             angle = 360 + angle;
 
-        //找到馅饼的相关部分。
-        double startAngle = 0.0;
-
-        for(int row = 0; row < model()->rowCount(rootIndex()); ++row){
-            QModelIndex index = model()->index(row,1,rootIndex());
-            double value = model()->data(index).toDouble();
-            if(value > 0.0){
-                double sliceAngle = 360 * value / totalValue;
-                if(angle >= startAngle && angle < (startAngle + sliceAngle))
-                    return model()->index(row,1,rootIndex());
-
-                startAngle += sliceAngle;
-            }
-        }
+        //在扇区角度索引中二分查找馅饼的相关部分。
+        int slice = aggregate->sliceAt(angle);
+        if(slice >= 0)
+            return model()->index(aggregate->sliceRows().at(slice),1,rootIndex());
     }else{
         //QFontMetrics提供字体度量信息。height返回字体高度
-        double itemHeight = QFontMetrics(viewOptions().font).height();
+        double itemHeight = legendItemHeight();
         //得到彩条数量
         int listItem = int((wy - margin) / itemHeight);
-        int validRow = 0;
-
-        for(int row = 0; row < model()->rowCount(rootIndex()); ++row){
-            QModelIndex index = model()->index(row,1,rootIndex());
-            if(model()->data(index).toDouble() > 0.0){
-                if(listItem == validRow) //到所选彩条位置时
-                    return model()->index(row,0,rootIndex()); //返回所选彩条的位置索引
-
-                //更新与下一个有效行对应的列表索引
-                ++validRow;
-            }
-        }
+        //彩条位置直接对应有效行序号
+        const int row = aggregate->rowForSlot(listItem);
+        if(row >= 0)
+            return model()->index(row,0,rootIndex()); //返回所选彩条的位置索引
     }
     return QModelIndex();
 }
 
-//当项在模型中发生更改时，将调用此槽
+//当项在模型中发生更改时，将调用此槽。只记下变化的行范围，下一轮事件循环中一次处理
 void PieView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
 {
     QAbstractItemView::dataChanged(topLeft,bottomRight,roles);
 
-    //QVector动态数组模板。contains模板有值则true。DisplayRole以文本形式呈现数据
-    if(!roles.contains(Qt::DisplayRole))
-        return;
+    //只清除变化的行中对应角色的缓存：颜色对应DecorationRole，彩条文字对应DisplayRole
+    if(topLeft.parent() == rootIndex() && topLeft.column() == 0)
+        invalidateRowCaches(topLeft.row(),bottomRight.row(),roles.isEmpty() || roles.contains(Qt::DecorationRole),
+                            roles.isEmpty() || roles.contains(Qt::DisplayRole));
 
-    validItems = 0; //有多少条数据
-    totalValue = 0.0; //总值
-
-    //rowCount给定父节点下的行数。rootIndex模型根项索引。
-    for(int row = 0; row < model()->rowCount(rootIndex()); ++row){
-        //返回模型中由给定行、列和父索引指定的项索引
-        QModelIndex index = model()->index(row,1,rootIndex());
-        //返回索引项的数据
-        double value = model()->data(index,Qt::DisplayRole).toDouble();
-        if(value > 0.0){
-            totalValue += value;
-            validItems++;
-        }
+    //颜色(第0列的DecorationRole)改变时只需要重画缓存层
+    if((roles.isEmpty() || roles.contains(Qt::DecorationRole)) && topLeft.parent() == rootIndex() && topLeft.column() == 0){
+        pieLayerDirty = true;
+        viewport()->update();
     }
-    //返回viewport(视口)小部件。更新小部件
-    viewport()->update();
+    //数值的变化由共享的汇总处理，处理完发出changed
 }
 
-//行被插入时调用。这函数在此项目中好像作用不大
-void PieView::rowsInserted(const QModelIndex &parent, int start, int end)
+//选择改变。同一帧里第一次按选择区域重绘，之后的直接整个重绘，不再一次次计算区域
+void PieView::selectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
 {
-    for(int row = start; row <= end; ++row){
-        QModelIndex index = model()->index(row,1,rootIndex());
-        double value = model()->data(index).toDouble();
-        if(value > 0.0){
-            totalValue += value;
-            ++validItems;
-        }
+    if(selectionRepaintPending){
+        viewport()->update();
+        return;
     }
-    QAbstractItemView::rowsInserted(parent,start,end);
+    selectionRepaintPending = true;
+    QAbstractItemView::selectionChanged(selected,deselected);
 }
 
-//当行将删除行后，右边的圆视图条目会减少
-void PieView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+//根项改变后显示的是另一组行，换成这组行的汇总
+void PieView::setRootIndex(const QModelIndex &index)
 {
-    for(int row = start; row <= end; ++row){
-        QModelIndex index = model()->index(row,1,rootIndex());
-        double value = model()->data(index).toDouble();
-        if(value > 0.0){
-            totalValue -= value;
-            --validItems;
-        }
+    QAbstractItemView::setRootIndex(index);
+    attachAggregate();
+}
+
+//取得模型和根项的共享汇总。其他视图已经算好时直接使用
+void PieView::attachAggregate()
+{
+    if(aggregate)
+        disconnect(aggregate.data(),&ChartAggregate::changed,this,&PieView::aggregateChanged);
+    aggregate = ChartAggregate::instance(model(),rootIndex());
+    connect(aggregate.data(),&ChartAggregate::changed,this,&PieView::aggregateChanged);
+    aggregateChanged(true);
+}
+
+//处理推迟的模型通知。界面中由事件循环处理；离屏绘制前没有事件循环，由调用者先处理
+void PieView::applyPendingChanges()
+{
+    aggregate->update();
+}
+
+//汇总变了：圆要重画，彩条个数可能变了。行号变了时按行的缓存都要清空
+void PieView::aggregateChanged(bool rowsRenumbered)
+{
+    if(rowsRenumbered){
+        rowColors.clear();
+        rowColorValid.clear();
+        legendTexts.clear();
     }
-    QAbstractItemView::rowsAboutToBeRemoved(parent,start,end);
+    pieLayerDirty = true;
+    updateGeometries();
+    viewport()->update();
 }
 
 //开始编辑与给定索引对应的项
@@ -224,49 +262,135 @@ void PieView::setSelection(const QRect &rect, QItemSelectionModel::SelectionFlag
     //translated返回矩形的副本。normalized返回一个规格化的矩形。这里是把rect的x坐标给horizontalScrollBar()->value()
     QRect contentsRect = rect.translated(horizontalScrollBar()->value(),verticalScrollBar()->value()).normalized();
 
-    int rows = model()->rowCount(rootIndex()); // 所有行数
-    int columns = model()->columnCount(rootIndex()); //所有列数
-    QModelIndexList indexes; //被选中的项
-
-    for(int row = 0; row < rows; ++row){
-        for(int column = 0; column < columns; ++column){
-            QModelIndex index = model()->index(row, column, rootIndex());
-            //itemRegion是自定义函数，为圆中选中的项。QRegion为绘画指定一个剪辑区域。
-            QRegion region = itemRegion(index);
-            //区域相交返回true，也就是选择多项圆份额时。
-            if(region.intersects(contentsRect))
-                indexes.append(index); //在列表的末尾插入值。
+    //拖动橡皮筋时每次鼠标移动都会调用。间隔太短时先记下来，由定时器在间隔到了之后处理最后一次
+    if(state() == DragSelectingState && selectionClock.isValid() && selectionClock.elapsed() < selectionInterval){
+        pendingSelectionRect = contentsRect;
+        pendingSelectionCommand = command;
+        selectionPending = true;
+        if(!selectionTimer){
+            selectionTimer = new QTimer(this);
+            selectionTimer->setSingleShot(true);
+            connect(selectionTimer,&QTimer::timeout,this,&PieView::flushSelection);
+        }
+        if(!selectionTimer->isActive())
+            selectionTimer->start(int(selectionInterval - selectionClock.elapsed()));
+        return;
+    }
+    applySelection(contentsRect,command);
+    update();
+}
+
+//计算矩形选中的行列范围并提交给选择模型。直接用角度和彩条位置求交，不再逐项构造区域
+void PieView::applySelection(const QRect &contentsRect, QItemSelectionModel::SelectionFlags command)
+{
+    ChartProfileScope profile(ChartProfiler::Selection);
+    selectionClock.start();
+    selectionPending = false;
+
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    const int slices = sliceRows.size();
+
+    int firstRow = INT_MAX, lastRow = -1; //选中的行范围
+    int firstColumn = INT_MAX, lastColumn = -1; //选中的列范围
+
+    //圆中的份额(第1列)：矩形与圆相交部分的角度范围
+    double from = 0.0, to = 0.0;
+    if(slices > 0 && pieAngleSpan(QRectF(contentsRect),&from,&to)){
+        int firstSlice = 0, lastSlice = slices - 1;
+        if(to - from < 360.0){
+            //跨过0度时分成两段，两段的行范围合并后就是整个圆
+            if(to > 360.0){
+                firstSlice = 0;
+                lastSlice = slices - 1;
+            }else{
+                firstSlice = aggregate->sliceAt(from);
+                lastSlice = aggregate->sliceAt(to);
+                if(firstSlice < 0)
+                    firstSlice = slices - 1;
+                if(lastSlice < 0)
+                    lastSlice = slices - 1;
+            }
         }
+        firstRow = sliceRows.at(firstSlice);
+        lastRow = sliceRows.at(lastSlice);
+        firstColumn = lastColumn = 1;
     }
 
-    if(indexes.size() > 0){
-        //索引位置的项对应的行。
-        int firstRow = indexes.at(0).row();
-        int lastRow = firstRow;
-        //索引位置对应的列
-        int firstColumn = indexes.at(0).column();
-        int lastColumn = firstColumn;
-
-        //得到绘制每份的起始和终止。
-        for(int i = 1; i < indexes.size(); ++i){
-            firstRow = qMin(firstRow,indexes.at(i).row()); //小
-            lastRow = qMax(lastRow,indexes.at(i).row()); //大
-            firstColumn = qMin(firstColumn,indexes.at(i).column());
-            lastColumn = qMax(lastColumn,indexes.at(i).column());
+    //圆右边的彩条(第0列)：彩条高度固定，直接算出矩形覆盖的彩条位置
+    const int itemHeight = legendItemHeight();
+    if(slices > 0 && itemHeight > 0 && contentsRect.right() >= totalSize && contentsRect.left() < totalSize + totalSize - margin){
+        int firstSlot = qMax(int(std::floor(double(contentsRect.top() - margin) / itemHeight)),0);
+        int lastSlot = qMin(int(std::floor(double(contentsRect.bottom() - margin) / itemHeight)),slices - 1);
+        if(firstSlot <= lastSlot){
+            firstRow = qMin(firstRow,sliceRows.at(firstSlot));
+            lastRow = qMax(lastRow,sliceRows.at(lastSlot));
+            firstColumn = 0;
+            lastColumn = qMax(lastColumn,0);
         }
+    }
 
+    if(lastRow < 0){
+        //什么都没选中：交给选择模型一个空选择，ClearAndSelect时清除原来的选择。
+        //拖动再回到项上时从头比较，不与移出前的范围做差
+        selectionModel()->select(QItemSelection(),command);
+        lastSelectionCells = QRect();
+        lastSelectionCommand = command;
+        return;
+    }
+
+    //行列范围保存在一个矩形里：left/right为列，top/bottom为行
+    const QRect cells(QPoint(firstColumn,firstRow),QPoint(lastColumn,lastRow));
+    if(state() == DragSelectingState && cells == lastSelectionCells && command == lastSelectionCommand)
+        return; //与上次相同，不用再通知选择模型
+
+    //同一次拖动中命令不变、列范围不变时，上一次的ClearAndSelect已经让选中内容等于上次的范围，
+    //这时只需要选中新增的行、取消移出的行，效果与整个范围ClearAndSelect相同
+    const QItemSelectionModel::SelectionFlags behavior = command & (QItemSelectionModel::Rows | QItemSelectionModel::Columns);
+    const bool clearAndSelect = (command & ~behavior) == QItemSelectionModel::ClearAndSelect;
+    if(state() == DragSelectingState && clearAndSelect && command == lastSelectionCommand && lastSelectionCells.isValid()
+            && cells.left() == lastSelectionCells.left() && cells.right() == lastSelectionCells.right()
+            && cells.top() <= lastSelectionCells.bottom() && cells.bottom() >= lastSelectionCells.top()){
+        QItemSelection added, removed;
+        auto addRows = [&](QItemSelection &selection,int top,int bottom){
+            if(top <= bottom)
+                selection.select(model()->index(top,cells.left(),rootIndex()),model()->index(bottom,cells.right(),rootIndex()));
+        };
+        addRows(added,cells.top(),lastSelectionCells.top() - 1);
+        addRows(added,lastSelectionCells.bottom() + 1,cells.bottom());
+        addRows(removed,lastSelectionCells.top(),cells.top() - 1);
+        addRows(removed,cells.bottom() + 1,lastSelectionCells.bottom());
+        if(!removed.isEmpty())
+            selectionModel()->select(removed,QItemSelectionModel::Deselect | behavior);
+        if(!added.isEmpty())
+            selectionModel()->select(added,QItemSelectionModel::Select | behavior);
+    }else{
         //管理模型中所选项目的信息。
         QItemSelection selection(model()->index(firstRow,firstColumn,rootIndex()),model()->index(lastRow,lastColumn,rootIndex()));
 
         //selectionModel返回当前选择模型。select使用指定的命令选择模型项索引。command描述了选择模型的更新方式。
         selectionModel()->select(selection,command);
     }
+    lastSelectionCells = cells;
+    lastSelectionCommand = command;
+}
+
+//处理拖动时被推迟的最后一次选择
+void PieView::flushSelection()
+{
+    if(selectionTimer)
+        selectionTimer->stop();
+    if(!selectionPending)
+        return;
+    applySelection(pendingSelectionRect,pendingSelectionCommand);
     update();
 }
 
 //鼠标按下
 void PieView::mousePressEvent(QMouseEvent *event)
 {
+    //新的一次点击或拖动，不再与上一次的选择比较
+    lastSelectionCells = QRect();
+    selectionPending = false;
     QAbstractItemView::mousePressEvent(event);
     origin = event->pos(); //小部件的位置
     if(!rubberBand) //显示新的边界区域，橡皮筋
@@ -284,20 +408,50 @@ void PieView::mouseMoveEvent(QMouseEvent *event)
         rubberBand->setGeometry(QRect(origin,event->pos()).normalized()); //设置橡皮筋几何形状
     QAbstractItemView::mouseMoveEvent(event);
 
+    //没有按键时才是悬停，拖动橡皮筋时不改变高亮
+    if(hoverEnabled && event->buttons() == Qt::NoButton)
+        setHoverIndex(indexAt(event->pos()));
 }
 
 //释放鼠标后调用改函数
 void PieView::mouseReleaseEvent(QMouseEvent *event)
 {
+    //拖动结束前把推迟的选择处理掉，保证最终选中的是松开鼠标时的范围
+    if(state() == DragSelectingState)
+        flushSelection();
     QAbstractItemView::mouseReleaseEvent(event);
     if(rubberBand)
         rubberBand->hide(); //小部件可见
     viewport()->update(); //更新视口部件
 }
 
+//鼠标离开视口
+void PieView::leaveEvent(QEvent *event)
+{
+    QAbstractItemView::leaveEvent(event);
+    setHoverIndex(QModelIndex());
+}
+
+//字体或样式改变后彩条高度和文字排版都变了
+void PieView::changeEvent(QEvent *event)
+{
+    QAbstractItemView::changeEvent(event);
+    if(event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange){
+        cachedItemHeight = -1;
+        legendTexts.clear();
+        updateGeometries();
+        viewport()->update();
+    }
+}
+
 //绘制圆和旁边的彩色条
 void PieView::paintEvent(QPaintEvent *event)
 {
+    ChartProfileScope profile(ChartProfiler::Paint,true); //每次绘制是一帧
+    //只读汇总。推迟的模型通知由汇总在事件循环中处理，处理完发出changed再重画，绘制中不改滚动范围
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    selectionRepaintPending = false;
+
     //跟踪视图的选中项，或同一模型中的多个视图
     QItemSelectionModel *selections = selectionModel();
     //在视图小部件中绘制项目的参数
@@ -318,80 +472,104 @@ void PieView::paintEvent(QPaintEvent *event)
     //视口矩形。pieRect为圆的直径
     QRect pieRect = QRect(margin,margin,pieSize,pieSize);
 
-    if(validItems <= 0) //没有数据时不进行绘画
+    if(aggregate->validItems() <= 0) //没有数据时不进行绘画
         return;
 
-    painter.save(); //保存当前绘制状态
-    //平移确定坐标后画圆，用pieRect是看有没有设置边距(margin)
-    painter.translate(pieRect.x() - horizontalScrollBar()->value(),pieRect.y() - verticalScrollBar()->value());
-    qDebug() << horizontalScrollBar()->value();
-    painter.drawEllipse(0,0,pieSize,pieSize); //画圆
-
-    /* 以上的代码只画了一个圆，里面还没有颜色跟分块 。下面代码画圆和填充颜色*/
-
-    double startAngle = 0.0; //开始角度
-    int row;
-    //遍历父节点下的行数
-    for(row = 0; row < model()->rowCount(rootIndex()); ++row){
-        QModelIndex index = model()->index(row,1,rootIndex());
-        double value = model()->data(index).toDouble(); //数据
-
-        //在有数据的情况下，根据数据来绘制圆的颜色和份数
-        if(value > 0.0){
-            double angle = 360 * value / totalValue; //每份数据所需要的角度份额，角度
-            QModelIndex colorIndex = model()->index(row,0,rootIndex());
-
-            //圆的颜色。DecorationRole要以图标的形式作为装饰呈现的数据。第一列数据的图标是颜色块，所以可以用来填充圆
-            QColor color = QColor(model()->data(colorIndex,Qt::DecorationRole).toString());
-            qDebug() << model()->data(colorIndex);
+    //圆的主体画在缓存层中，只有数据、大小或颜色变化时才重画，平时直接贴图
+    {
+        ChartProfileScope layerProfile(ChartProfiler::PaintLayer);
+        updatePieLayer(foreground);
+        if(painter.paintEngine()->type() == QPaintEngine::Raster){
+            painter.drawPixmap(pieRect.x() - 1 - horizontalScrollBar()->value(),pieRect.y() - 1 - verticalScrollBar()->value(),pieLayer);
+        }else{
+            //画到SVG、打印机等矢量设备时直接画，不用位图
+            painter.save();
+            painter.translate(pieRect.x() - horizontalScrollBar()->value(),pieRect.y() - verticalScrollBar()->value());
+            paintPie(painter);
+            painter.restore();
+        }
+    }
 
-            //currentIndex当前项目的模型索引。这里为圆中份额全部选中时
-            if(currentIndex() == index){
-                //setBrush设置填充颜色和模式
-                painter.setBrush(QBrush(color,Qt::Dense4Pattern));
+    /* 选中、当前和悬停的份额画在缓存层上面，只画这几份 */
+
+    {
+        ChartProfileScope overlayProfile(ChartProfiler::PaintOverlay);
+        painter.save(); //保存当前绘制状态
+        //平移确定坐标后画圆，用pieRect是看有没有设置边距(margin)
+        painter.translate(pieRect.x() - horizontalScrollBar()->value(),pieRect.y() - verticalScrollBar()->value());
+
+        //跟踪视图选中项，选中部分圆份额时用Dense3Pattern
+        const QItemSelection selection = selections->selection();
+        for(const QItemSelectionRange &range : selection){
+            if(range.parent() != rootIndex() || range.left() > 1 || range.right() < 1)
+                continue;
+            //扇区按行号排列，所以一段行对应一段连续的扇区
+            const int first = int(std::lower_bound(sliceRows.cbegin(),sliceRows.cend(),range.top()) - sliceRows.cbegin());
+            const int last = int(std::upper_bound(sliceRows.cbegin(),sliceRows.cend(),range.bottom()) - sliceRows.cbegin());
+            paintSlotRange(painter,first,last,Qt::Dense3Pattern,background);
+        }
+        //悬停的份额颜色变亮，选中的份额不变。份额在合并的组里时高亮整组，否则看不见
+        if(hoverIndex.isValid() && hoverIndex.parent() == rootIndex()){
+            const int slot = aggregate->slotForRow(hoverIndex.row());
+            if(slot >= 0 && !selections->isSelected(model()->index(hoverIndex.row(),1,rootIndex()))){
+                const int group = groupForSlot(slot);
+                paintSliceOverlay(painter,sliceGroups.at(group),sliceGroups.at(group + 1),sliceBrush(groupColor(group).lighter(125)),background);
             }
-            //跟踪视图选中项，选择了给定的模型索引。选中部分圆份额时。
-            else if(selections->isSelected(index)){
-                painter.setBrush(QBrush(color,Qt::Dense3Pattern));
-            }else
-                painter.setBrush(QBrush(color));
-
-            //用指定的宽度和高度以及给定的开始角度和跨度角绘制从(x, y)开始的矩形定义的饼。乘16，要比数据条数多2
-            painter.drawPie(0,0,pieSize,pieSize,int(startAngle*16),int(angle*16));
-            startAngle += angle;
         }
+        //currentIndex当前项目的模型索引，用Dense4Pattern
+        if(currentIndex().isValid() && currentIndex().column() == 1 && currentIndex().parent() == rootIndex()){
+            const int slot = aggregate->slotForRow(currentIndex().row());
+            if(slot >= 0){
+                const int group = groupForSlot(slot);
+                paintSliceOverlay(painter,sliceGroups.at(group),sliceGroups.at(group + 1),sliceBrush(groupColor(group),Qt::Dense4Pattern),background);
+            }
+        }
+        painter.restore(); //恢复状态
     }
-    painter.restore(); //恢复状态
 
     /* 下面代码绘制圆右边的色条和文字 */
 
-    int keyNumber = 0; //颜色条绘制的次数
-    for(row = 0; row < model()->rowCount(rootIndex());++row){
-        QModelIndex index = model()->index(row,1,rootIndex()); //数值数据
-        double value = model()->data(index).toDouble();
-        if(value > 0.0){
-            //rootIndex返回模型根项的模型索引
-            QModelIndex labelIndex = model()->index(row,0,rootIndex()); //第一列的数据
-            qDebug() << model()->data(labelIndex);
-            //在视图小部件中绘制项目的参数
-            QStyleOptionViewItem option = viewOptions();
-
-            //得到绘制彩条文字的真正范围坐标
-            option.rect = visualRect(labelIndex);
-
-            //跟踪视图选中项，选择了给定的模型索引
-            if(selections->isSelected(labelIndex)){
-                //绘制基本元素时使用的标志。用于指示是否选择小部件
-                option.state |= QStyle::State_Selected;
-            }
-            if(currentIndex() == labelIndex){ //启动后的第一个项
-                //用于指示小部件是否有焦点
-                option.state |= QStyle::State_HasFocus;
-            }
-            //itemDelegate视图和模型使用的项委托。paint是抽象函数，实现自定义项委托。这条代码用来绘制色条和文字。
-            itemDelegate()->paint(&painter,option,labelIndex);
-            ++keyNumber;
+    //彩条高度固定，直接算出与需要更新的区域相交的第一个和最后一个，只画这些。
+    //数据再多，每次画的彩条数也只取决于视口的高度
+    const int itemHeight = legendItemHeight();
+    const QRect dirty = event->rect().translated(horizontalScrollBar()->value(),verticalScrollBar()->value()); //内容坐标
+    if(itemHeight <= 0 || dirty.right() < totalSize || dirty.left() >= totalSize + totalSize - margin)
+        return;
+    ChartProfileScope legendProfile(ChartProfiler::PaintLegend);
+    const int firstSlot = qMax(int(std::floor(double(dirty.top() - margin) / itemHeight)),0);
+    const int lastSlot = qMin(int(std::floor(double(dirty.bottom() - margin) / itemHeight)),sliceRows.size() - 1);
+
+    //在视图小部件中绘制项目的参数，每个彩条在它的基础上修改
+    const QStyleOptionViewItem baseOption = viewOptions();
+    for(int slot = firstSlot; slot <= lastSlot; ++slot){
+        const int row = sliceRows.at(slot);
+        //rootIndex返回模型根项的模型索引
+        QModelIndex labelIndex = model()->index(row,0,rootIndex()); //第一列的数据
+        pieDebug() << model()->data(labelIndex);
+        QStyleOptionViewItem option = baseOption;
+
+        //得到绘制彩条文字的真正范围坐标
+        option.rect = visualRect(labelIndex);
+
+        //跟踪视图选中项，选择了给定的模型索引
+        if(selections->isSelected(labelIndex)){
+            //绘制基本元素时使用的标志。用于指示是否选择小部件
+            option.state |= QStyle::State_Selected;
+        }
+        if(currentIndex() == labelIndex){ //启动后的第一个项
+            //用于指示小部件是否有焦点
+            option.state |= QStyle::State_HasFocus;
+        }
+        if(hoverIndex.isValid() && hoverIndex.row() == row){ //鼠标悬停的彩条
+            option.state |= QStyle::State_MouseOver;
         }
+        //itemDelegate视图和模型使用的项委托。paint是抽象函数，实现自定义项委托。这条代码用来绘制色条和文字。
+        //默认委托每次都要重新排版文字，这时改用缓存的颜色块和文字来画
+        QAbstractItemDelegate *delegate = itemDelegate(labelIndex);
+        if(delegate->metaObject() == &QStyledItemDelegate::staticMetaObject)
+            paintLegendItem(painter,option,row);
+        else
+            delegate->paint(&painter,option,labelIndex);
     }
 }
 
@@ -408,25 +586,71 @@ void PieView::scrollContentsBy(int dx, int dy)
 
 //返回给定选择项的视口中的区域。以视口坐标返回与所选内容对应的区域。
 //返回"所选项"选择的剪辑区域。
+//按起点排序后合并重叠或相接的扇区段
+static void mergeSpans(QVector<QPair<int,int>> *spans)
+{
+    if(spans->size() < 2)
+        return;
+    std::sort(spans->begin(),spans->end());
+    int count = 1;
+    for(int i = 1; i < spans->size(); ++i){
+        QPair<int,int> &previous = (*spans)[count - 1];
+        const QPair<int,int> &span = spans->at(i);
+        if(span.first <= previous.second)
+            previous.second = qMax(previous.second,span.second);
+        else
+            (*spans)[count++] = span;
+    }
+    spans->resize(count);
+}
+
+//按范围计算，不再逐项合并矩形：一段行对应一段连续的扇区，彩条合成一个矩形，扇区用这一段的外接矩形。
+//全选只有一个范围，行数再多也只有两个矩形
 QRegion PieView::visualRegionForSelection(const QItemSelection &selection) const
 {
-    //selection管理模型中所选项目的信息。count返回列表中项的数量，与size()相同
-    int ranges = selection.count();
-    if(ranges == 0)
-        return QRect();
+    ChartProfileScope profile(ChartProfiler::SelectionRegion);
+    if(selection.isEmpty() || aggregate->validItems() <= 0)
+        return QRegion();
 
-    QRegion region; //为画家指定一个剪辑区域
-    for(int i = 0; i < ranges; ++i){
-        //模型中选定项目范围的信息
-        const QItemSelectionRange &range = selection.at(i);
-        //top返回与选择范围中最上面所选行对应的行索引。bottom最低。
-        for(int row = range.top(); row <= range.bottom(); ++row){
-            //left最左，right最右
-            for(int col = range.left(); col <= range.right(); ++col){
-                QModelIndex index = model()->index(row,col,rootIndex());
-                region += visualRect(index); //索引处的几何形状
-            }
-        }
+    //每个范围落在哪一段有效扇区[first,last)，第0列的画彩条，第1列的画扇区
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    QVector<QPair<int,int>> legendSpans;
+    QVector<QPair<int,int>> wedgeSpans;
+    for(const QItemSelectionRange &range : selection){
+        if(range.parent() != rootIndex())
+            continue;
+        const int first = int(std::lower_bound(sliceRows.cbegin(),sliceRows.cend(),range.top()) - sliceRows.cbegin());
+        const int last = int(std::upper_bound(sliceRows.cbegin(),sliceRows.cend(),range.bottom()) - sliceRows.cbegin());
+        if(first >= last)
+            continue;
+        if(range.left() <= 0)
+            legendSpans.append(qMakePair(first,last));
+        if(range.left() <= 1 && range.right() >= 1)
+            wedgeSpans.append(qMakePair(first,last));
+    }
+    mergeSpans(&legendSpans);
+    mergeSpans(&wedgeSpans);
+
+    const int dx = horizontalScrollBar()->value();
+    const int dy = verticalScrollBar()->value();
+    QRegion region;
+
+    //合并后的彩条矩形上下不相接，已按位置排好，可以一次设置
+    const int itemHeight = legendItemHeight();
+    if(itemHeight > 0 && !legendSpans.isEmpty()){
+        QVector<QRect> rects;
+        rects.reserve(legendSpans.size());
+        for(const QPair<int,int> &span : legendSpans)
+            rects.append(QRect(totalSize - dx,margin + span.first * itemHeight - dy,totalSize - margin,(span.second - span.first) * itemHeight));
+        region.setRects(rects.constData(),rects.size());
+    }
+
+    //扇区段太多时直接用整个圆，不再一段段合并
+    if(wedgeSpans.size() > 32){
+        region += QRect(margin - 1 - dx,margin - 1 - dy,pieSize + 2,pieSize + 2);
+    }else{
+        for(const QPair<int,int> &span : wedgeSpans)
+            region += sliceBounds(span.first,span.second).translated(-dx,-dy);
     }
     return region;
 }
@@ -438,32 +662,15 @@ QRect PieView::itemRect(const QModelIndex &index) const
     if(!index.isValid()) //模型索引有效为true
         return QRect();
 
-    QModelIndex valueIndex; //第二列的数据
-
-    //传进来的参数会是第几列
-    if(index.column() != 1){//column模型索引所引用的列
-        //拿到第0列行对应的数值。
-        valueIndex = model()->index(index.row(),1,rootIndex());
-        qDebug()<<model()->data(valueIndex);
-        qDebug()<<model()->data(index);
-    }
-    else
-        valueIndex = index;
-
-    if(model()->data(valueIndex).toDouble() <= 0.0)
+    //通过行号查出彩条位置(第几个有效行)，数值不大于0的行没有彩条
+    const int listItem = aggregate->slotForRow(index.row());
+    if(listItem < 0)
         return QRect();
 
-    int listItem = 0; //数据量计数
-    //第一次进函数时index.row为1，因为是第二行。为后面绘制彩条文字起作用，每一个彩条绘制一个矩形。
-    for(int row = index.row()-1;row >= 0; --row){
-        if(model()->data(model()->index(row,1,rootIndex())).toDouble() > 0.0)
-            listItem++;
-    }
-
     switch (index.column()) {
     case 0:{
         //字体的高度
-        const qreal itemHeight = QFontMetrics(viewOptions().font).height();
+        const qreal itemHeight = legendItemHeight();
         //得到绘制彩条文字的范围矩形。qRound:四舍五入到最接近的整数。这句是本函数的核心代码
         return QRect(totalSize,qRound(margin + listItem * itemHeight),totalSize - margin,qRound(itemHeight));
     }
@@ -473,38 +680,79 @@ QRect PieView::itemRect(const QModelIndex &index) const
     return QRect();
 }
 
-//圆形被选择的区域，返回指定一个剪辑区域。
-QRegion PieView::itemRegion(const QModelIndex &index) const
+//计算矩形与圆相交部分覆盖的角度范围(度，逆时针，0度在3点钟方向，与drawPie一致)。
+//不相交返回false。矩形包含圆心时覆盖整个圆，to - from为360。跨过0度时to会大于360
+bool PieView::pieAngleSpan(const QRectF &rect, double *from, double *to) const
 {
-    if(!index.isValid())
-        return QRegion();
+    const double radius = pieSize / 2.0;
+    const QPointF center(margin + radius,margin + radius);
 
-    if(index.column() !=1) //索引引用的列。确保选择的一定要是这列
-        return itemRect(index); //索引位置的项矩形
-    if(model()->data(index).toDouble() <= 0.0)
-        return QRegion();
+    //圆心到矩形的最近点比半径还远，不相交
+    const double nx = qBound(rect.left(),center.x(),rect.right()) - center.x();
+    const double ny = qBound(rect.top(),center.y(),rect.bottom()) - center.y();
+    if(nx * nx + ny * ny > radius * radius)
+        return false;
 
-    double startAngle = 0.0; //开始画圆弧的地方
-    for(int row  = 0; row < model()->rowCount(rootIndex());++row){
-        QModelIndex sliceIndex = model()->index(row,1,rootIndex());
-        double value = model()->data(sliceIndex).toDouble();
-        if(value > 0.0){
-            double angle = 360 * value / totalValue; //角度
-            if(sliceIndex == index){ //找到选中的数值时
-                QPainterPath slicePath; //绘图容器
-                //将当前位置移动到x，y
-                slicePath.moveTo(totalSize / 2,totalSize / 2);
-                //创建一个圆弧,占用矩形QRectF(x,y,宽度,高度),从指定的startAngle开始，并逆时针延伸angel度
-                slicePath.arcTo(margin,margin,margin+pieSize,margin+pieSize,startAngle,angle);
-                //绘画，关闭子路径启动新的路径
-                slicePath.closeSubpath();
-                //toFillPolygon将路径转换为多边形并返回。toPolygon通过将每个QPointF转换为QPoint创建并返回一个QPolygon,最终返回一个整数精度的点向量。
-                return QRegion(slicePath.toFillPolygon().toPolygon());
-            }
-            startAngle += angle; //每查询一个数值就加角度
+    if(rect.contains(center)){
+        *from = 0.0;
+        *to = 360.0;
+        return true;
+    }
+
+    //矩形与圆的交集是不含圆心的凸区域，角度的两个极值一定在它的顶点上：
+    //圆内的矩形顶点，以及矩形的边与圆周的交点
+    QVector<QPointF> points;
+    const QPointF corners[4] = {rect.topLeft(),rect.topRight(),rect.bottomLeft(),rect.bottomRight()};
+    for(const QPointF &corner : corners){
+        const QPointF d = corner - center;
+        if(d.x() * d.x() + d.y() * d.y() <= radius * radius)
+            points.append(corner);
+    }
+    for(double x : {rect.left(),rect.right()}){ //竖直的边
+        const double dx = x - center.x();
+        if(dx * dx > radius * radius)
+            continue;
+        const double h = std::sqrt(radius * radius - dx * dx);
+        for(double y : {center.y() - h,center.y() + h}){
+            if(y >= rect.top() && y <= rect.bottom())
+                points.append(QPointF(x,y));
+        }
+    }
+    for(double y : {rect.top(),rect.bottom()}){ //水平的边
+        const double dy = y - center.y();
+        if(dy * dy > radius * radius)
+            continue;
+        const double w = std::sqrt(radius * radius - dy * dy);
+        for(double x : {center.x() - w,center.x() + w}){
+            if(x >= rect.left() && x <= rect.right())
+                points.append(QPointF(x,y));
         }
     }
-    return QRegion();
+    if(points.isEmpty())
+        return false;
+
+    //以第一个点的角度为基准展开，避免在0度处断开。凸区域不含圆心，跨度不会超过180度
+    auto angleOf = [&](const QPointF &p){
+        //正y表示中心以上
+        double angle = qRadiansToDegrees(std::atan2(center.y() - p.y(),p.x() - center.x()));
+        return angle < 0 ? angle + 360 : angle;
+    };
+    const double base = angleOf(points.first());
+    double low = 0.0, high = 0.0;
+    for(const QPointF &p : points){
+        double d = angleOf(p) - base;
+        if(d > 180.0)
+            d -= 360.0;
+        else if(d <= -180.0)
+            d += 360.0;
+        low = qMin(low,d);
+        high = qMax(high,d);
+    }
+    *from = base + low;
+    if(*from < 0)
+        *from += 360.0;
+    *to = *from + (high - low);
+    return true;
 }
 
 //返回给定索引的模型项的父项
@@ -521,7 +769,354 @@ void PieView::updateGeometries()
     horizontalScrollBar()->setPageStep(viewport()->width());
     //设置滑块的最小值和最大值。
     horizontalScrollBar()->setRange(0,qMax(0,2 * totalSize - viewport()->width()));
-    //垂直滑动块设置
+    //垂直滑动块设置。内容高度取圆和彩条列表中较高的一个，彩条多时可以滚动到最后一个
+    const int itemHeight = legendItemHeight();
+    const qint64 legendHeight = 2 * margin + qint64(aggregate->validItems()) * itemHeight;
+    const int contentsHeight = int(qMin<qint64>(qMax<qint64>(totalSize,legendHeight),INT_MAX));
     verticalScrollBar()->setPageStep(viewport()->height());
-    verticalScrollBar()->setRange(0,qMax(0,totalSize - viewport()->height()));
+    verticalScrollBar()->setSingleStep(itemHeight);
+    verticalScrollBar()->setRange(0,qMax(0,contentsHeight - viewport()->height()));
+}
+
+//导出用的快照。彩条的位置、颜色块和文字与paintEvent中画的相同，文字按当前宽度省略好
+PieScene PieView::exportScene(qreal scale) const
+{
+    aggregate->update(); //导出不经过绘制，先处理推迟的模型通知
+    const QStyleOptionViewItem option = viewOptions();
+    PieScene scene;
+    scene.area = QRect(QPoint(horizontalScrollBar()->value(),verticalScrollBar()->value()),viewport()->size());
+    scene.margin = margin;
+    scene.pieSize = pieSize;
+    scene.background = option.palette.base().color().rgb();
+    scene.foreground = option.palette.color(QPalette::WindowText).rgb();
+    scene.textColor = option.palette.color(QPalette::Text).rgb();
+    scene.font = option.font.toString();
+    if(aggregate->validItems() <= 0)
+        return scene;
+
+    //细小份额按导出的分辨率合并，放大后能看见的份额单独画
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    QVector<int> groups;
+    QVector<QRgb> colors;
+    groupSlices(scale,&groups,&colors);
+    scene.wedges.reserve(groups.size() - 1);
+    for(int group = 0; group + 1 < groups.size(); ++group){
+        const int first = groups.at(group);
+        const int last = groups.at(group + 1);
+        PieScene::Wedge wedge;
+        sliceSpan(first,last,&wedge.start,&wedge.span);
+        wedge.color = last - first == 1 ? sliceColor(sliceRows.at(first)).rgb() : colors.at(group);
+        wedge.bounds = sliceBounds(first,last);
+        scene.wedges.append(wedge);
+    }
+
+    //与导出区域相交的彩条
+    const int itemHeight = legendItemHeight();
+    if(itemHeight <= 0)
+        return scene;
+    const QFontMetrics metrics(option.font);
+    const int textMargin = style()->pixelMetric(QStyle::PM_FocusFrameHMargin,nullptr,this) + 1;
+    const int firstSlot = qMax(int(std::floor(double(scene.area.top() - margin) / itemHeight)),0);
+    const int lastSlot = qMin(int(std::floor(double(scene.area.bottom() - margin) / itemHeight)),sliceRows.size() - 1);
+    for(int slot = firstSlot; slot <= lastSlot; ++slot){
+        const int row = sliceRows.at(slot);
+        PieScene::LegendItem item;
+        item.rect = QRect(totalSize,margin + slot * itemHeight,totalSize - margin,itemHeight);
+        item.swatch = QRect(item.rect.left() + textMargin,item.rect.top() + (item.rect.height() - option.decorationSize.height()) / 2,
+                            option.decorationSize.width(),option.decorationSize.height());
+        const int textLeft = item.swatch.right() + 1 + 2 * textMargin;
+        item.baseline = QPointF(textLeft,item.rect.top() + (item.rect.height() - itemHeight) / 2.0 + metrics.ascent());
+        item.color = sliceColor(row).rgb();
+        item.text = metrics.elidedText(sliceLabel(row),Qt::ElideRight,qMax(item.rect.right() - textLeft - textMargin,0));
+        scene.legend.append(item);
+    }
+    return scene;
+}
+
+//更新悬停项，只在悬停项变化时重绘
+void PieView::setHoverIndex(const QModelIndex &index)
+{
+    if(hoverIndex == index)
+        return;
+    hoverIndex = index;
+    viewport()->update();
+}
+
+//一行的标签。ChartModel按编号查标签字典
+QString PieView::sliceLabel(int row) const
+{
+    //汇总还没处理删除行的通知时，行号可能超出模型
+    if(chartModel && !rootIndex().isValid())
+        return row < chartModel->chartData().size() ? chartModel->chartData().label(row) : QString();
+    return model()->data(model()->index(row,0,rootIndex()),Qt::DisplayRole).toString();
+}
+
+//一行的颜色。ChartModel直接读颜色数组
+QColor PieView::sliceColor(int row) const
+{
+    if(chartModel && !rootIndex().isValid())
+        return row < int(chartModel->colors().size()) ? QColor(chartModel->colors()[size_t(row)]) : QColor();
+    //其他模型每行的颜色只解析一次。末尾追加的行在用到时扩大缓存
+    if(row >= rowColorValid.size()){
+        rowColors.resize(qMax(aggregate->rowCount(),row + 1));
+        rowColorValid.resize(rowColors.size());
+    }
+    if(!rowColorValid.testBit(row)){
+        //DecorationRole要以图标的形式作为装饰呈现的数据。第一列数据的图标是颜色块，所以可以用来填充圆
+        rowColors[row] = QColor(model()->data(model()->index(row,0,rootIndex()),Qt::DecorationRole).toString()).rgb();
+        rowColorValid.setBit(row);
+    }
+    return QColor(rowColors.at(row));
+}
+
+//画刷按颜色和样式缓存。不同颜色的数量一般不多，超过上限时清空重来
+const QBrush &PieView::sliceBrush(const QColor &color, Qt::BrushStyle style) const
+{
+    const quint64 key = quint64(color.rgba()) << 8 | quint64(style);
+    auto it = brushes.constFind(key);
+    if(it != brushes.constEnd())
+        return it.value();
+    if(brushes.size() >= 4096)
+        brushes.clear();
+    return *brushes.insert(key,QBrush(color,style));
+}
+
+int PieView::legendItemHeight() const
+{
+    if(cachedItemHeight < 0)
+        cachedItemHeight = QFontMetrics(viewOptions().font).height(); //QFontMetrics提供字体度量信息
+    return cachedItemHeight;
+}
+
+//文字按宽度省略后排好版。只有看得见的彩条才会用到，缓存几屏的数量就够了
+const QStaticText &PieView::legendText(int row, int width) const
+{
+    if(width != legendTextWidth){
+        legendTexts.clear();
+        legendTextWidth = width;
+    }
+    auto it = legendTexts.constFind(row);
+    if(it != legendTexts.constEnd())
+        return it.value();
+    if(legendTexts.size() >= 4096)
+        legendTexts.clear();
+
+    const QFont font = viewOptions().font;
+    QStaticText text(QFontMetrics(font).elidedText(sliceLabel(row),Qt::ElideRight,qMax(width,0)));
+    text.setTextFormat(Qt::PlainText);
+    text.prepare(QTransform(),font);
+    return *legendTexts.insert(row,text);
+}
+
+void PieView::invalidateRowCaches(int first, int last, bool colors, bool texts)
+{
+    first = qMax(first,0);
+    if(colors && first < rowColorValid.size())
+        rowColorValid.fill(false,first,qMin(last + 1,rowColorValid.size()));
+    if(texts && !legendTexts.isEmpty()){
+        if(last - first + 1 > legendTexts.size()){
+            //范围比缓存还大时遍历缓存
+            for(auto it = legendTexts.begin(); it != legendTexts.end();){
+                if(it.key() >= first && it.key() <= last)
+                    it = legendTexts.erase(it);
+                else
+                    ++it;
+            }
+        }else{
+            for(int row = first; row <= last; ++row)
+                legendTexts.remove(row);
+        }
+    }
+}
+
+//颜色块在左，文字在右，与QStyledItemDelegate画颜色装饰和文字的布局相同
+void PieView::paintLegendItem(QPainter &painter, const QStyleOptionViewItem &option, int row)
+{
+    style()->drawPrimitive(QStyle::PE_PanelItemViewItem,&option,&painter,this);
+
+    const QRect rect = option.rect;
+    const int textMargin = style()->pixelMetric(QStyle::PM_FocusFrameHMargin,nullptr,this) + 1;
+    const QSize swatch = option.decorationSize;
+    const QRect colorRect(rect.left() + textMargin,rect.top() + (rect.height() - swatch.height()) / 2,swatch.width(),swatch.height());
+    painter.fillRect(colorRect,sliceBrush(sliceColor(row)));
+
+    const int textLeft = colorRect.right() + 1 + 2 * textMargin;
+    const bool selected = option.state & QStyle::State_Selected;
+    painter.setPen(option.palette.color(selected ? QPalette::HighlightedText : QPalette::Text));
+    painter.drawStaticText(QPointF(textLeft,rect.top() + (rect.height() - legendItemHeight()) / 2.0),
+                           legendText(row,rect.right() - textLeft - textMargin));
+
+    if(option.state & QStyle::State_HasFocus){
+        QStyleOptionFocusRect focus;
+        focus.QStyleOption::operator=(option);
+        focus.backgroundColor = option.palette.color(selected ? QPalette::Highlight : QPalette::Window);
+        style()->drawPrimitive(QStyle::PE_FrameFocusRect,&focus,&painter,this);
+    }
+}
+
+//扇区first到last(不含)合起来的起始角度和跨度，单位为1/16度，与drawPie一致。
+//起止角度分别取整再相减，相邻的扇区之间不会有缝
+void PieView::sliceSpan(int first, int last, int *start, int *span) const
+{
+    const QVector<double> &sliceEnds = aggregate->sliceEnds();
+    const double scale = 360 * 16 / sliceEnds.last();
+    const int from = qRound((first > 0 ? sliceEnds.at(first - 1) : 0.0) * scale);
+    const int to = qRound(sliceEnds.at(last - 1) * scale);
+    *start = from;
+    *span = to - from;
+}
+
+//扇区first到last(不含)合起来的外接矩形，内容坐标。由圆心、两条半径的端点和弧跨过的上下左右四个极点算出，
+//抗锯齿和画笔会多画一个像素
+QRect PieView::sliceBounds(int first, int last) const
+{
+    int start, span;
+    sliceSpan(first,last,&start,&span);
+    const double radius = pieSize / 2.0;
+    const QPointF center(margin + radius,margin + radius);
+    if(span >= 360 * 16)
+        return QRect(margin - 1,margin - 1,pieSize + 2,pieSize + 2);
+
+    double left = center.x(), right = center.x(), top = center.y(), bottom = center.y();
+    auto include = [&](double degrees){
+        //逆时针为正，屏幕的y轴向下
+        const double x = center.x() + radius * std::cos(qDegreesToRadians(degrees));
+        const double y = center.y() - radius * std::sin(qDegreesToRadians(degrees));
+        left = qMin(left,x);
+        right = qMax(right,x);
+        top = qMin(top,y);
+        bottom = qMax(bottom,y);
+    };
+    const double from = start / 16.0;
+    const double to = (start + span) / 16.0;
+    include(from);
+    include(to);
+    for(double axis = std::ceil(from / 90) * 90; axis < to; axis += 90)
+        include(axis);
+    return QRectF(QPointF(left,top),QPointF(right,bottom)).toAlignedRect().adjusted(-1,-1,1,1);
+}
+
+//把扇区分组。一个扇区在圆周上的弧长不到一个设备像素时，与后面同样细小的扇区合为一组，
+//直到这一组够一个像素宽。这样组数不超过圆周的像素数加上较大扇区的个数
+void PieView::groupSlices(qreal ratio, QVector<int> *groups, QVector<QRgb> *colors) const
+{
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    const QVector<double> &sliceEnds = aggregate->sliceEnds();
+    const int count = sliceRows.size();
+    groups->clear();
+    colors->clear();
+
+    //一个设备像素的弧长对应的数值
+    const double threshold = lodEnabled && count > 0 ? sliceEnds.last() / (M_PI * pieSize * ratio) : 0.0;
+
+    int slot = 0;
+    while(slot < count){
+        const double from = slot > 0 ? sliceEnds.at(slot - 1) : 0.0;
+        int last = slot + 1;
+        if(sliceEnds.at(slot) - from < threshold){
+            while(last < count && sliceEnds.at(last - 1) - from < threshold && sliceEnds.at(last) - sliceEnds.at(last - 1) < threshold)
+                ++last;
+        }
+        groups->append(slot);
+
+        //合并的组按数值加权求平均色
+        QRgb color = 0;
+        if(last - slot > 1){
+            double red = 0, green = 0, blue = 0;
+            for(int i = slot; i < last; ++i){
+                const QRgb rgb = sliceColor(sliceRows.at(i)).rgb();
+                const double weight = sliceEnds.at(i) - (i > 0 ? sliceEnds.at(i - 1) : 0.0);
+                red += qRed(rgb) * weight;
+                green += qGreen(rgb) * weight;
+                blue += qBlue(rgb) * weight;
+            }
+            const double weight = sliceEnds.at(last - 1) - from;
+            color = qRgb(int(red / weight),int(green / weight),int(blue / weight));
+        }
+        colors->append(color);
+        slot = last;
+    }
+    groups->append(count);
+}
+
+//扇区所在的组：最后一个起点不大于slot的组
+int PieView::groupForSlot(int slot) const
+{
+    return int(std::upper_bound(sliceGroups.cbegin(),sliceGroups.cend() - 1,slot) - sliceGroups.cbegin()) - 1;
+}
+
+QColor PieView::groupColor(int group) const
+{
+    const QVector<int> &sliceRows = aggregate->sliceRows();
+    const int first = sliceGroups.at(group);
+    if(sliceGroups.at(group + 1) - first == 1)
+        return sliceColor(sliceRows.at(first));
+    return QColor(groupColors.at(group));
+}
+
+//按需重画圆的缓存层。层比圆大1像素的边，给抗锯齿的画笔留出位置；按设备像素比例分配，高分屏上不模糊
+void PieView::updatePieLayer(const QPen &pen)
+{
+    const qreal ratio = viewport()->devicePixelRatioF();
+    if(!pieLayerDirty && !pieLayer.isNull() && pieLayer.devicePixelRatio() == ratio && pieLayerPen == pen.color())
+        return;
+
+    groupSlices(ratio,&sliceGroups,&groupColors);
+    const int side = pieSize + 2;
+    pieLayer = QPixmap(QSize(qCeil(side * ratio),qCeil(side * ratio)));
+    pieLayer.setDevicePixelRatio(ratio);
+    pieLayer.fill(Qt::transparent);
+
+    QPainter painter(&pieLayer);
+    painter.setRenderHint(QPainter::Antialiasing); //抗锯齿
+    painter.setPen(pen);
+    painter.translate(1,1);
+    paintPie(painter);
+
+    pieLayerDirty = false;
+    pieLayerPen = pen.color();
+}
+
+//画圆和所有份额，左上角在(0,0)
+void PieView::paintPie(QPainter &painter)
+{
+    painter.drawEllipse(0,0,pieSize,pieSize); //画圆
+
+    //每组画一块，细小的份额合在一起画
+    for(int group = 0; group + 1 < sliceGroups.size(); ++group){
+        const QColor color = groupColor(group);
+        pieDebug() << aggregate->sliceRows().at(sliceGroups.at(group)) << color;
+        painter.setBrush(sliceBrush(color));
+        int start, span;
+        sliceSpan(sliceGroups.at(group),sliceGroups.at(group + 1),&start,&span);
+        //用指定的宽度和高度以及给定的开始角度和跨度角绘制从(x, y)开始的矩形定义的饼
+        painter.drawPie(0,0,pieSize,pieSize,start,span);
+    }
+}
+
+//在缓存层上面重画一块：先用背景色盖住，图案画刷的空隙才会像原来一样露出背景
+void PieView::paintSliceOverlay(QPainter &painter, int first, int last, const QBrush &brush, const QBrush &background)
+{
+    int start, span;
+    sliceSpan(first,last,&start,&span);
+    const QPen pen = painter.pen();
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(background);
+    painter.drawPie(0,0,pieSize,pieSize,start,span);
+    painter.setPen(pen);
+    painter.setBrush(brush);
+    painter.drawPie(0,0,pieSize,pieSize,start,span);
+}
+
+//重画扇区first到last(不含)。单个扇区的组用本行颜色，合并的组中落在范围内的部分用组的颜色整块画，
+//所以选中再多的行，画的块数也不超过组数
+void PieView::paintSlotRange(QPainter &painter, int first, int last, Qt::BrushStyle pattern, const QBrush &background)
+{
+    int slot = first;
+    while(slot < last){
+        const int group = groupForSlot(slot);
+        const int end = qMin(last,sliceGroups.at(group + 1));
+        paintSliceOverlay(painter,slot,end,sliceBrush(groupColor(group),pattern),background);
+        slot = end;
+    }
 }
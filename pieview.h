@@ -2,6 +2,20 @@
 #define PIEVIEW_H
 
 #include <QAbstractItemView> //视图基本功能
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPixmap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QStaticText>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+class ChartAggregate;
+class ChartModel;
+struct PieScene;
 
 class PieView : public QAbstractItemView
 {
@@ -10,6 +24,27 @@ class PieView : public QAbstractItemView
 public:
     PieView(QWidget *parent = nullptr);
 
+    //设置模型。数值汇总与同一模型上的其他视图共享
+    void setModel(QAbstractItemModel *model) override;
+
+    //悬停跟踪：开启后鼠标移动即高亮光标下的份额和彩条
+    void setHoverTracking(bool enable);
+    bool hoverTracking() const { return hoverEnabled; }
+
+    //细节层次：开启后(默认)窄于一个像素的相邻份额合并成一块来画，绘制开销只取决于圆的大小
+    void setLevelOfDetail(bool enable);
+    bool levelOfDetail() const { return lodEnabled; }
+
+    //导出用的快照：当前视口看到的部分，细小份额按放大scale倍后的分辨率合并。
+    //不含选中、当前和悬停状态。快照可以交给其他线程用ChartExport画成大图
+    PieScene exportScene(qreal scale) const;
+    //立即处理推迟的模型通知。修改模型后不经过事件循环就render时先调用
+    void applyPendingChanges();
+
+public slots:
+    //设置根项，显示根项下的行
+    void setRootIndex(const QModelIndex &index) override;
+
     //得到圆右边彩条文字的绘制范围矩形
     QRect visualRect(const QModelIndex &index) const override;
 
@@ -24,11 +59,8 @@ protected slots:
     //当项在模型中发生更改时，将调用此槽
     void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles = QVector<int>()) override;
 
-    //行被插入时调用。把模型中的数据插入视图
-    void rowsInserted(const QModelIndex &parent, int start, int end) override;
-
-    //当行将删除行后，右边的圆视图条目会减少
-    void rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end) override;
+    //选择改变时重绘。同一帧中多次改变只计算一次区域
+    void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected) override;
 
 protected:
     //开始编辑与给定索引对应的项。点击视图中的任意项都会触发这函数
@@ -57,6 +89,12 @@ protected:
     //释放鼠标后调用改函数。 这个三个鼠标事件用于在界面拖动显示一个矩形
     void mouseReleaseEvent(QMouseEvent *event) override;
 
+    //鼠标离开视口时清除悬停高亮
+    void leaveEvent(QEvent *event) override;
+
+    //字体或样式改变时重算彩条高度，文字要重新排版
+    void changeEvent(QEvent *event) override;
+
     //绘制圆和旁边的彩色条
     void paintEvent(QPaintEvent *event) override;
     //接收在event参数中传递的小部件调整大小事件。当调用resizeEvent()时，小部件已经有了新的几何形状。
@@ -72,24 +110,105 @@ protected:
 private:
     //得到圆右边彩条文字的绘制范围矩形
     QRect itemRect(const QModelIndex &item) const;
-    //圆形被选择的区域，返回指定一个剪辑区域。
-    QRegion itemRegion(const QModelIndex &index) const;
+    //矩形与圆相交部分覆盖的角度范围，不相交返回false
+    bool pieAngleSpan(const QRectF &rect, double *from, double *to) const;
+    //按内容坐标中的矩形选择，setSelection节流后调用
+    void applySelection(const QRect &contentsRect, QItemSelectionModel::SelectionFlags command);
+    //处理拖动时被推迟的最后一次选择
+    void flushSelection();
     //返回给定父节点下的行数
     int rows(const QModelIndex &index = QModelIndex()) const;
     //设置滚动条。窗口拉小时滚动条就会显示出来
     void updateGeometries() override;
 
+    //取得当前模型和根项的共享汇总
+    void attachAggregate();
+    //汇总处理完模型通知后调用
+    void aggregateChanged(bool rowsRenumbered);
+    //更新悬停项，并重绘变化的区域
+    void setHoverIndex(const QModelIndex &index);
+
+    //一行的标签和颜色
+    QString sliceLabel(int row) const;
+    QColor sliceColor(int row) const;
+    //某种颜色和样式的画刷。按颜色和样式缓存，绘制时不再每次新建
+    const QBrush &sliceBrush(const QColor &color, Qt::BrushStyle style = Qt::SolidPattern) const;
+    //彩条的高度，即字体高度。字体改变前只算一次
+    int legendItemHeight() const;
+    //一行彩条的文字，按宽度省略后预先排好版。按行缓存
+    const QStaticText &legendText(int row, int width) const;
+    //first到last行的颜色或文字缓存失效
+    void invalidateRowCaches(int first, int last, bool colors, bool texts);
+    //用缓存的颜色块和文字画一个彩条，效果与默认委托相同
+    void paintLegendItem(QPainter &painter, const QStyleOptionViewItem &option, int row);
+    //扇区first到last(不含)合起来的起始角度和跨度，单位为1/16度
+    void sliceSpan(int first, int last, int *start, int *span) const;
+    //扇区first到last(不含)合起来的外接矩形，内容坐标
+    QRect sliceBounds(int first, int last) const;
+    //按圆在设备像素比例ratio下的大小把扇区分组，细小的相邻扇区合为一组。colors为合并组的平均色
+    void groupSlices(qreal ratio, QVector<int> *groups, QVector<QRgb> *colors) const;
+    //扇区所在的组
+    int groupForSlot(int slot) const;
+    //一组的颜色：单个扇区为本行颜色，合并的组为按数值加权的平均色
+    QColor groupColor(int group) const;
+    //按需重画圆的缓存层
+    void updatePieLayer(const QPen &pen);
+    //画圆和所有份额
+    void paintPie(QPainter &painter);
+    //在缓存层上面重画扇区first到last(不含)，选中、当前或悬停时使用
+    void paintSliceOverlay(QPainter &painter, int first, int last, const QBrush &brush, const QBrush &background);
+    //重画扇区first到last(不含)，合并的组整块画，pattern为画刷模式
+    void paintSlotRange(QPainter &painter, int first, int last, Qt::BrushStyle pattern, const QBrush &background);
+
     //圆与左右两边物体的间距,通过控制圆的大小来实现。圆变小后右边的彩色条和字体会变高
     int margin = 10; 
     int totalSize = 300; //圆的直径
     int pieSize = totalSize - 2 * margin; //圆的最终大小直径
-    int validItems = 0; //有多少条数据
-    double totalValue = 0.0; //总值
 
     //QRubberBand类提供了一个矩形或直线，可以指示选择或边界。
     QRubberBand *rubberBand = nullptr;
     QPoint origin; //小部件的位置
 
+    //模型是ChartModel时直接读取它的数值和颜色数组，不经过QVariant
+    //模型销毁后自动为空
+    QPointer<const ChartModel> chartModel;
+
+    //每行数值、有效行数、总值和扇区角度索引。同一模型和根项的所有视图共用一份，
+    //模型通知在其中合并处理，在事件循环中处理完后发出changed。绘制和查询只读
+    QSharedPointer<ChartAggregate> aggregate;
+    bool selectionRepaintPending = false; //这一帧已经按选择区域安排过重绘
+
+    //拖动选择的节流。两次选择的最短间隔(毫秒)，间隔内的移动只记下最后一次
+    int selectionInterval = 16;
+    QElapsedTimer selectionClock; //距离上次选择的时间
+    QTimer *selectionTimer = nullptr; //间隔到了之后处理推迟的选择
+    bool selectionPending = false;
+    QRect pendingSelectionRect;
+    QItemSelectionModel::SelectionFlags pendingSelectionCommand;
+    //上次提交的选择范围(left/right为列，top/bottom为行)和命令，用于只提交变化的行
+    QRect lastSelectionCells;
+    QItemSelectionModel::SelectionFlags lastSelectionCommand;
+
+    //圆的缓存层：圆和所有份额按普通颜色画好，paintEvent直接贴图。选中等状态画在它上面
+    QPixmap pieLayer;
+    bool pieLayerDirty = true;
+    QColor pieLayerPen; //画缓存层时的画笔颜色，调色板改变后要重画
+
+    bool lodEnabled = true; //是否合并细小份额
+    QVector<int> sliceGroups; //每组的第一个扇区，最后多放一个sliceRows.size()
+    QVector<QRgb> groupColors; //合并组的平均色，单个扇区的组不用
+
+    //绘制用的缓存。行号都是根项下的行号，行的增删或重排后全部清空，dataChanged只清除变化的行和角色
+    mutable QVector<QRgb> rowColors; //模型不是ChartModel时每行解析好的颜色
+    mutable QBitArray rowColorValid; //rowColors中哪些行已经解析
+    mutable QHash<quint64,QBrush> brushes; //按颜色和样式缓存的画刷
+    mutable QHash<int,QStaticText> legendTexts; //排好版的彩条文字
+    mutable int legendTextWidth = -1; //legendTexts排版时的宽度
+    mutable int cachedItemHeight = -1; //彩条高度，-1表示字体改变后还没有算
+
+    bool hoverEnabled = false; //是否开启悬停跟踪
+    QPersistentModelIndex hoverIndex; //鼠标悬停处的项
+
 };
 
 #endif // PIEVIEW_H
@@ -0,0 +1,574 @@
+﻿#include "sunburstview.h"
+#include <QtWidgets>
+#include <cmath>
+
+SunburstView::SunburstView(QWidget *parent):QAbstractItemView(parent)
+{
+    //整个图总是按视口大小画，不需要滚动条
+    horizontalScrollBar()->setRange(0,0);
+    verticalScrollBar()->setRange(0,0);
+}
+
+//设置模型
+void SunburstView::setModel(QAbstractItemModel *model)
+{
+    if(this->model()){
+        disconnect(this->model(),&QAbstractItemModel::layoutChanged,this,&SunburstView::invalidateTree);
+        disconnect(this->model(),&QAbstractItemModel::rowsRemoved,this,&SunburstView::rowsRemoved);
+    }
+
+    QAbstractItemView::setModel(model);
+
+    if(model){
+        connect(model,&QAbstractItemModel::layoutChanged,this,&SunburstView::invalidateTree);
+        connect(model,&QAbstractItemModel::rowsRemoved,this,&SunburstView::rowsRemoved);
+    }
+    invalidateTree();
+}
+
+void SunburstView::reset()
+{
+    QAbstractItemView::reset();
+    invalidateTree();
+}
+
+void SunburstView::setRootIndex(const QModelIndex &index)
+{
+    QAbstractItemView::setRootIndex(index);
+    invalidateTree();
+}
+
+//项的子树总值
+double SunburstView::itemTotal(const QModelIndex &index) const
+{
+    const int node = nodeForIndex(index);
+    return node >= 0 ? nodeSums.at(node) : 0.0;
+}
+
+//项所在环段的外接矩形
+QRect SunburstView::visualRect(const QModelIndex &index) const
+{
+    const int node = nodeForIndex(index);
+    if(node <= 0 || nodeSums.at(node) <= 0)
+        return QRect();
+    double start, span;
+    nodeSpan(node,&start,&span);
+    return segmentPath(nodeDepth(node),start,span).boundingRect().toAlignedRect();
+}
+
+void SunburstView::scrollTo(const QModelIndex &/*index*/, QAbstractItemView::ScrollHint /*hint*/)
+{
+}
+
+//命中测试：半径决定层，角度换算成数值后从根往下，每层在子节点的前缀和中二分
+QModelIndex SunburstView::indexAt(const QPoint &point) const
+{
+    updateTree();
+    const double total = nodeSums.value(0);
+    if(total <= 0 || depthCount == 0)
+        return QModelIndex();
+
+    const QPointF offset = QPointF(point) - QRectF(viewport()->rect()).center();
+    const double radius = std::hypot(offset.x(),offset.y());
+    const double ring = outerRadius(1) - innerRadius(1);
+    if(ring <= 0 || radius < innerRadius(1) || radius >= outerRadius(depthCount))
+        return QModelIndex();
+    const int depth = qMin(int((radius - innerRadius(1)) / ring) + 1,depthCount);
+
+    double angle = qRadiansToDegrees(std::atan2(-offset.y(),offset.x()));
+    if(angle < 0)
+        angle += 360.0;
+    double target = angle / 360.0 * total; //在父节点范围内的数值位置
+    int node = 0;
+    for(int level = 1; level <= depth; ++level){
+        if(nodeChildCount.at(node) == 0 || nodeSums.at(node) <= 0)
+            return QModelIndex(); //这一层没有子项
+        const int child = childAt(node,target);
+        target -= childPrefix(node,child);
+        node = nodeFirstChild.at(node) + child;
+    }
+    if(nodeSums.at(node) <= 0)
+        return QModelIndex();
+    return indexForNode(node);
+}
+
+//数值变化只修正变化的叶子到根的路径
+void SunburstView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    QAbstractItemView::dataChanged(topLeft,bottomRight,roles);
+    if(treeDirty || !topLeft.isValid())
+        return; //重建时会重新读取
+
+    const bool values = roles.isEmpty() || roles.contains(Qt::DisplayRole) || roles.contains(Qt::EditRole);
+    const bool colors = roles.isEmpty() || roles.contains(Qt::DecorationRole);
+    bool changed = false;
+    if(values && topLeft.column() <= 1 && bottomRight.column() >= 1){
+        const int parent = nodeForIndex(topLeft.parent());
+        if(parent >= 0){
+            const int first = nodeFirstChild.at(parent);
+            const int last = qMin(bottomRight.row(),nodeChildCount.at(parent) - 1);
+            for(int row = topLeft.row(); row <= last; ++row){
+                const int node = first + row;
+                if(nodeChildCount.at(node) > 0)
+                    continue; //有子项的项数值为子项之和
+                const double delta = itemValue(topLeft.sibling(row,1)) - nodeSums.at(node);
+                if(delta != 0){
+                    addToPath(node,delta);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    if(changed || colors){
+        layoutDirty = true;
+        layerDirty = true;
+        viewport()->update();
+    }
+}
+
+//插入行改变了节点的排列。只做标记，一批插入不管分成几次通知，都在下次绘制或查询时重建一次
+void SunburstView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QAbstractItemView::rowsInserted(parent,start,end);
+    if(!treeDirty)
+        invalidateTree();
+}
+
+void SunburstView::rowsRemoved(const QModelIndex &/*parent*/, int /*start*/, int /*end*/)
+{
+    invalidateTree();
+}
+
+bool SunburstView::edit(const QModelIndex &index, QAbstractItemView::EditTrigger trigger, QEvent *event)
+{
+    if(index.column() == 0)
+        return QAbstractItemView::edit(index,trigger,event);
+    else
+        return false;
+}
+
+//左右上下在兄弟项之间移动，上翻页到父项，下翻页到第一个子项
+QModelIndex SunburstView::moveCursor(QAbstractItemView::CursorAction cursorAction, Qt::KeyboardModifiers /*modifiers*/)
+{
+    QModelIndex current = currentIndex();
+    if(!current.isValid())
+        return model()->index(0,0,rootIndex());
+
+    const int rows = model()->rowCount(current.parent());
+    switch (cursorAction) {
+    case MoveLeft:
+    case MoveUp:
+        current = current.sibling(qMax(current.row() - 1,0),current.column());
+        break;
+    case MoveRight:
+    case MoveDown:
+        current = current.sibling(qMin(current.row() + 1,rows - 1),current.column());
+        break;
+    case MovePageUp:
+        if(current.parent() != rootIndex())
+            current = current.parent();
+        break;
+    case MovePageDown:
+        if(model()->rowCount(current.sibling(current.row(),0)) > 0)
+            current = model()->index(0,0,current.sibling(current.row(),0));
+        break;
+    default:
+        break;
+    }
+    viewport()->update();
+    return current;
+}
+
+int SunburstView::horizontalOffset() const
+{
+    return horizontalScrollBar()->value();
+}
+
+int SunburstView::verticalOffset() const
+{
+    return verticalScrollBar()->value();
+}
+
+bool SunburstView::isIndexHidden(const QModelIndex &/*index*/) const
+{
+    return false;
+}
+
+//选择与矩形相交的环段。先按矩形到圆心的距离排除整层，只对剩下的环段做路径相交测试
+void SunburstView::setSelection(const QRect &rect, QItemSelectionModel::SelectionFlags command)
+{
+    updateLayout();
+    const QRectF area = QRectF(rect.normalized());
+    const QPointF center = QRectF(viewport()->rect()).center();
+    //矩形上离圆心最近和最远的距离
+    const double dx = qMax(qMax(area.left() - center.x(),center.x() - area.right()),0.0);
+    const double dy = qMax(qMax(area.top() - center.y(),center.y() - area.bottom()),0.0);
+    const double nearest = std::hypot(dx,dy);
+    const double farthest = std::hypot(qMax(std::abs(area.left() - center.x()),std::abs(area.right() - center.x())),
+                                       qMax(std::abs(area.top() - center.y()),std::abs(area.bottom() - center.y())));
+
+    QItemSelection selection;
+    for(const Segment &segment : qAsConst(segments)){
+        if(segment.node < 0)
+            continue; //合并的细小环段不能单独选中
+        if(outerRadius(segment.depth) < nearest || innerRadius(segment.depth) > farthest)
+            continue;
+        if(!segmentPath(segment.depth,segment.start,segment.span).intersects(area))
+            continue;
+        const QModelIndex index = indexForNode(segment.node);
+        const int lastColumn = qMin(model()->columnCount(index.parent()) - 1,1);
+        selection.append(QItemSelectionRange(index,index.sibling(index.row(),qMax(lastColumn,0))));
+    }
+    selectionModel()->select(selection,command);
+}
+
+QRegion SunburstView::visualRegionForSelection(const QItemSelection &selection) const
+{
+    if(selection.isEmpty())
+        return QRegion();
+    return viewport()->rect();
+}
+
+void SunburstView::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+    painter.setRenderHint(QPainter::Antialiasing);
+    const QPalette palette = viewOptions().palette; //与其他视图一样取视图选项的调色板
+    painter.fillRect(event->rect(),palette.base());
+
+    updateLayout();
+    if(segments.isEmpty())
+        return;
+
+    //缓存层在布局或颜色变化、大小或设备像素比变化时重画
+    const qreal ratio = viewport()->devicePixelRatioF();
+    const QSize size = viewport()->size() * ratio;
+    const bool raster = painter.paintEngine()->type() == QPaintEngine::Raster;
+    if(raster && (layerDirty || layer.size() != size || layer.devicePixelRatioF() != ratio)){
+        layer = QPixmap(size);
+        layer.setDevicePixelRatio(ratio);
+        layer.fill(Qt::transparent);
+        QPainter layerPainter(&layer);
+        layerPainter.setRenderHint(QPainter::Antialiasing);
+        const QPen separator(palette.base().color(),0); //环段之间的分隔线
+        for(const Segment &segment : qAsConst(segments)){
+            layerPainter.setPen(segment.node < 0 ? QPen(Qt::NoPen) : separator);
+            layerPainter.setBrush(QColor::fromRgba(segment.color));
+            layerPainter.drawPath(segmentPath(segment.depth,segment.start,segment.span));
+        }
+        layerDirty = false;
+    }
+    if(raster){
+        painter.drawPixmap(0,0,layer);
+    }else{
+        //打印或导出矢量图时直接画，保持矢量
+        painter.setPen(QPen(palette.base().color(),0));
+        for(const Segment &segment : qAsConst(segments)){
+            painter.setBrush(QColor::fromRgba(segment.color));
+            painter.drawPath(segmentPath(segment.depth,segment.start,segment.span));
+        }
+    }
+
+    //选中的项：同一父项下连续的行合成一段来画
+    painter.setPen(Qt::NoPen);
+    const QColor highlight = palette.highlight().color();
+    if(selectionModel()){
+        painter.setBrush(QBrush(highlight,Qt::Dense3Pattern));
+        const QItemSelection selection = selectionModel()->selection();
+        for(const QItemSelectionRange &range : selection){
+            const int parent = nodeForIndex(range.parent());
+            if(parent < 0 || range.top() >= nodeChildCount.at(parent))
+                continue;
+            const int first = nodeFirstChild.at(parent) + range.top();
+            const int last = nodeFirstChild.at(parent) + qMin(range.bottom(),nodeChildCount.at(parent) - 1);
+            double start, span, lastStart, lastSpan;
+            nodeSpan(first,&start,&span);
+            nodeSpan(last,&lastStart,&lastSpan);
+            if(lastStart + lastSpan > start)
+                painter.drawPath(segmentPath(nodeDepth(first),start,lastStart + lastSpan - start));
+        }
+    }
+
+    //当前项
+    const int current = nodeForIndex(currentIndex());
+    if(current > 0 && nodeSums.at(current) > 0){
+        double start, span;
+        nodeSpan(current,&start,&span);
+        painter.setBrush(QBrush(highlight,Qt::Dense4Pattern));
+        painter.drawPath(segmentPath(nodeDepth(current),start,span));
+    }
+}
+
+void SunburstView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractItemView::resizeEvent(event);
+    layoutDirty = true;
+    layerDirty = true;
+}
+
+void SunburstView::invalidateTree()
+{
+    treeDirty = true;
+    layoutDirty = true;
+    layerDirty = true;
+    viewport()->update();
+}
+
+//按层序读取整棵树：一个节点的子节点在它之后连续追加，所以同一父项的子项相邻。
+//之后从后往前累加子树总值，再为每组子节点建树状数组
+void SunburstView::updateTree() const
+{
+    if(!treeDirty)
+        return;
+    treeDirty = false;
+    layoutDirty = true;
+
+    nodeParents.clear();
+    nodeFirstChild.clear();
+    nodeChildCount.clear();
+    nodeRows.clear();
+    nodeSums.clear();
+    nodePrefix.clear();
+    depthCount = 0;
+    if(!model())
+        return;
+
+    QVector<QModelIndex> indexes; //只在读取时使用，节点缓存不保存模型索引
+    QVector<int> depths;
+    indexes.append(rootIndex());
+    depths.append(0);
+    nodeParents.append(-1);
+    nodeRows.append(-1);
+    for(int node = 0; node < indexes.size(); ++node){
+        const QModelIndex parent = indexes.at(node); //追加会让引用失效，复制一份
+        const int rows = model()->rowCount(parent);
+        nodeFirstChild.append(indexes.size());
+        nodeChildCount.append(rows);
+        for(int row = 0; row < rows; ++row){
+            indexes.append(model()->index(row,0,parent));
+            depths.append(depths.at(node) + 1);
+            nodeParents.append(node);
+            nodeRows.append(row);
+        }
+    }
+    depthCount = depths.last();
+
+    //子节点都排在父节点之后，从后往前一遍就能累加出所有子树总值
+    const int count = indexes.size();
+    nodeSums.fill(0.0,count);
+    for(int node = count - 1; node > 0; --node){
+        if(nodeChildCount.at(node) == 0)
+            nodeSums[node] = itemValue(indexes.at(node).sibling(nodeRows.at(node),1));
+        nodeSums[nodeParents.at(node)] += nodeSums.at(node);
+    }
+
+    //每组子节点原地建树状数组，O(n)
+    nodePrefix = nodeSums;
+    for(int node = 0; node < count; ++node){
+        const int base = nodeFirstChild.at(node) - 1; //树状数组从1开始编号
+        const int children = nodeChildCount.at(node);
+        for(int i = 1; i <= children; ++i){
+            const int up = i + (i & -i);
+            if(up <= children)
+                nodePrefix[base + up] += nodePrefix.at(base + i);
+        }
+    }
+}
+
+//布局只遍历画得出来的环段，细小的相邻子节点用树状数组一次跳过，
+//所以环段数只取决于视口大小，与节点数无关
+void SunburstView::updateLayout() const
+{
+    updateTree();
+    if(!layoutDirty)
+        return;
+    layoutDirty = false;
+    segments.clear();
+    if(nodeSums.value(0) <= 0 || depthCount == 0 || outerRadius(1) <= innerRadius(1))
+        return;
+    layoutChildren(0,1,rootIndex(),viewOptions().palette.color(QPalette::Mid));
+}
+
+double SunburstView::itemValue(const QModelIndex &index) const
+{
+    const double value = model()->data(index).toDouble();
+    return value > 0 ? value : 0.0;
+}
+
+//颜色为第0列的装饰数据，没有时按标签取一个固定的颜色
+QColor SunburstView::itemColor(const QModelIndex &index) const
+{
+    QColor color = qvariant_cast<QColor>(model()->data(index,Qt::DecorationRole));
+    if(!color.isValid())
+        color = QColor::fromHsv(int(qHash(model()->data(index).toString()) % 360),160,230);
+    return color;
+}
+
+//从模型索引往上记下每层的行号，再从根节点往下找
+int SunburstView::nodeForIndex(const QModelIndex &index) const
+{
+    updateTree();
+    if(!model() || nodeChildCount.isEmpty())
+        return -1;
+
+    QVarLengthArray<int,32> path;
+    QModelIndex current = index;
+    while(current != rootIndex()){
+        if(!current.isValid())
+            return -1; //不在根项下
+        path.append(current.row());
+        current = current.parent();
+    }
+
+    int node = 0;
+    for(int i = path.size() - 1; i >= 0; --i){
+        const int row = path.at(i);
+        if(row < 0 || row >= nodeChildCount.at(node))
+            return -1;
+        node = nodeFirstChild.at(node) + row;
+    }
+    return node;
+}
+
+QModelIndex SunburstView::indexForNode(int node) const
+{
+    QVarLengthArray<int,32> path;
+    for(; node > 0; node = nodeParents.at(node))
+        path.append(nodeRows.at(node));
+    QModelIndex index = rootIndex();
+    for(int i = path.size() - 1; i >= 0; --i)
+        index = model()->index(path.at(i),0,index);
+    return index;
+}
+
+double SunburstView::childPrefix(int parent, int count) const
+{
+    const int base = nodeFirstChild.at(parent) - 1;
+    double sum = 0.0;
+    for(int i = count; i > 0; i -= i & -i)
+        sum += nodePrefix.at(base + i);
+    return sum;
+}
+
+//在树状数组上二分：找出前缀和不超过target的最多个数，这之后的那个子节点就覆盖target
+int SunburstView::childAt(int parent, double target) const
+{
+    const int base = nodeFirstChild.at(parent) - 1;
+    const int count = nodeChildCount.at(parent);
+    int step = 1;
+    while(step * 2 <= count)
+        step *= 2;
+    int position = 0;
+    for(; step > 0; step >>= 1){
+        if(position + step <= count && nodePrefix.at(base + position + step) <= target){
+            position += step;
+            target -= nodePrefix.at(base + position);
+        }
+    }
+    return qMin(position,count - 1);
+}
+
+//每层修正本节点的总值和它在兄弟组树状数组中的前缀和，O(层数×log兄弟数)
+void SunburstView::addToPath(int node, double delta)
+{
+    for(; node > 0; node = nodeParents.at(node)){
+        const int parent = nodeParents.at(node);
+        const int base = nodeFirstChild.at(parent) - 1;
+        const int children = nodeChildCount.at(parent);
+        for(int i = node - base; i <= children; i += i & -i)
+            nodePrefix[base + i] += delta;
+        nodeSums[node] += delta;
+    }
+    nodeSums[0] += delta;
+}
+
+//起点为每层前面兄弟节点的数值之和累加
+void SunburstView::nodeSpan(int node, double *start, double *span) const
+{
+    *span = nodeSums.at(node);
+    double sum = 0.0;
+    for(; node > 0; node = nodeParents.at(node)){
+        const int parent = nodeParents.at(node);
+        sum += childPrefix(parent,node - nodeFirstChild.at(parent));
+    }
+    *start = sum;
+}
+
+int SunburstView::nodeDepth(int node) const
+{
+    int depth = 0;
+    for(; node > 0; node = nodeParents.at(node))
+        ++depth;
+    return depth;
+}
+
+//中间留出半个环宽的空洞，其余按层数平分
+double SunburstView::innerRadius(int depth) const
+{
+    const double radius = qMax(qMin(viewport()->width(),viewport()->height()) / 2 - margin,0);
+    return radius / (depthCount + 0.5) * (depth - 0.5);
+}
+
+double SunburstView::outerRadius(int depth) const
+{
+    return innerRadius(depth + 1);
+}
+
+//数值换算成角度，从3点钟方向开始逆时针
+QPainterPath SunburstView::segmentPath(int depth, double start, double span) const
+{
+    const double total = nodeSums.value(0);
+    const double angle = 360.0 * start / total;
+    const double sweep = 360.0 * span / total;
+    const QPointF center = QRectF(viewport()->rect()).center();
+    const double inner = innerRadius(depth);
+    const double outer = outerRadius(depth);
+    const QRectF outerRect(center.x() - outer,center.y() - outer,2 * outer,2 * outer);
+    const QRectF innerRect(center.x() - inner,center.y() - inner,2 * inner,2 * inner);
+
+    QPainterPath path;
+    path.arcMoveTo(outerRect,angle);
+    path.arcTo(outerRect,angle,sweep);
+    path.arcTo(innerRect,angle + sweep,-sweep);
+    path.closeSubpath();
+    return path;
+}
+
+void SunburstView::layoutChildren(int parent, int depth, const QModelIndex &parentIndex, double start, const QColor &parentColor) const
+{
+    const int first = nodeFirstChild.at(parent);
+    const int count = nodeChildCount.at(parent);
+    if(count == 0)
+        return;
+
+    //这一层外圈上一个设备像素对应的数值，比它小的子节点画不出来
+    const double minSpan = nodeSums.at(0) / (2 * M_PI * outerRadius(depth) * viewport()->devicePixelRatioF());
+    double offset = start;
+    int i = 0;
+    while(i < count){
+        const int child = first + i;
+        const double sum = nodeSums.at(child);
+        if(sum >= minSpan){
+            const QModelIndex index = model()->index(nodeRows.at(child),0,parentIndex);
+            const QColor color = itemColor(index);
+            segments.append({child,depth,offset,sum,color.rgba()});
+            layoutChildren(child,depth + 1,index,offset,color);
+            offset += sum;
+            ++i;
+            continue;
+        }
+
+        //从i开始的细小子节点合成一段，累计到一个像素为止，遇到画得出来的子节点就停
+        const double before = childPrefix(parent,i);
+        int last = childAt(parent,before + minSpan);
+        if(last > i && nodeSums.at(first + last) >= minSpan)
+            --last;
+        last = qMax(last,i);
+        const double merged = childPrefix(parent,last + 1) - before;
+        if(merged > 0)
+            segments.append({-1,depth,offset,merged,parentColor.lighter(115).rgba()});
+        offset += merged;
+        i = last + 1;
+    }
+}
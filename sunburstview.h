@@ -0,0 +1,130 @@
+﻿#ifndef SUNBURSTVIEW_H
+#define SUNBURSTVIEW_H
+
+#include <QAbstractItemView>
+#include <QPainterPath>
+#include <QPixmap>
+
+//旭日图：树形模型的每一层画成一圈圆环，子项在父项的角度范围内按数值分配角度。
+//第0列为标签，第1列为数值。有子项的项数值为子项之和，自己的数值不用。
+//节点缓存按层序排列，同一父项的子项连续存放，每组子项各有一棵树状数组记录数值前缀和。
+//叶子数值变化时只沿祖先路径修正，命中测试从根往下每层二分，都是对数时间
+class SunburstView : public QAbstractItemView
+{
+    Q_OBJECT
+
+public:
+    SunburstView(QWidget *parent = nullptr);
+
+    //设置模型。额外连接布局变化和行删除信号，节点缓存要重建
+    void setModel(QAbstractItemModel *model) override;
+    //项的子树总值，叶子为自己的数值，不在图中的项为0
+    double itemTotal(const QModelIndex &index) const;
+
+public slots:
+    //模型重置时重建节点缓存
+    void reset() override;
+    //设置根项，画根项下的整棵子树
+    void setRootIndex(const QModelIndex &index) override;
+
+    //项所在环段的外接矩形
+    QRect visualRect(const QModelIndex &index) const override;
+    //整个图总是完整显示，不需要滚动
+    void scrollTo(const QModelIndex &index, ScrollHint hint = EnsureVisible) override;
+    //视口坐标处的项。先由半径算出层，再从根往下按角度找子项
+    QModelIndex indexAt(const QPoint &point) const override;
+
+protected slots:
+    //叶子数值变化时沿祖先路径修正总值，颜色变化只重画
+    void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles = QVector<int>()) override;
+    //插入行后重建节点缓存
+    void rowsInserted(const QModelIndex &parent, int start, int end) override;
+
+protected:
+    //只有第0列(标签)可以编辑
+    bool edit(const QModelIndex &index, EditTrigger trigger, QEvent *event) override;
+    //左右上下在兄弟项之间移动
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
+
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex &index) const override;
+
+    //选择与矩形相交的环段
+    void setSelection(const QRect &rect, QItemSelectionModel::SelectionFlags command) override;
+    //选中的项可能在任何位置，重画整个视口
+    QRegion visualRegionForSelection(const QItemSelection &selection) const override;
+
+    //贴上缓存层，再画选中和当前项
+    void paintEvent(QPaintEvent *event) override;
+    //大小改变后环的半径跟着变，布局和缓存层都要重建
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    //行已经删除。基类没有对应的虚函数，在setModel中连接
+    void rowsRemoved(const QModelIndex &parent, int start, int end);
+    //节点缓存失效，下次使用时重建
+    void invalidateTree();
+    //按需从模型读取整棵树，算出每个节点的总值和前缀和
+    void updateTree() const;
+    //按需重新计算要画的环段
+    void updateLayout() const;
+    //从模型读取一项的数值，小于0按0算
+    double itemValue(const QModelIndex &index) const;
+    //项的颜色
+    QColor itemColor(const QModelIndex &index) const;
+
+    //模型索引对应的节点，根项为节点0，不在缓存中返回-1
+    int nodeForIndex(const QModelIndex &index) const;
+    //节点对应的模型索引(第0列)
+    QModelIndex indexForNode(int node) const;
+    //父节点的前count个子节点的数值之和
+    double childPrefix(int parent, int count) const;
+    //父节点的子节点中，累计数值覆盖target的那一个，返回子节点序号
+    int childAt(int parent, double target) const;
+    //叶子数值改变delta，沿祖先路径修正总值和前缀和
+    void addToPath(int node, double delta);
+    //节点在整圈中的起点和数值跨度，单位与数值相同
+    void nodeSpan(int node, double *start, double *span) const;
+    //节点所在的层，根项为0
+    int nodeDepth(int node) const;
+
+    //第depth层环的内外半径
+    double innerRadius(int depth) const;
+    double outerRadius(int depth) const;
+    //第depth层从数值start开始、跨度span的环段
+    QPainterPath segmentPath(int depth, double start, double span) const;
+    //从parent的子节点开始递归布置环段，细小的相邻子节点合成一段且不再往下画
+    void layoutChildren(int parent, int depth, const QModelIndex &parentIndex, double start, const QColor &parentColor) const;
+
+    //节点缓存，按层序排列，同一父项的子项连续存放。节点0为根项
+    mutable QVector<int> nodeParents; //父节点
+    mutable QVector<int> nodeFirstChild; //第一个子节点
+    mutable QVector<int> nodeChildCount; //子节点数
+    mutable QVector<int> nodeRows; //在父项下的行号
+    mutable QVector<double> nodeSums; //子树总值，叶子为自己的数值
+    //每组子节点的树状数组，与子节点存放在同样的位置，记录同组子节点数值的前缀和
+    mutable QVector<double> nodePrefix;
+    mutable int depthCount = 0; //除根以外的层数
+    mutable bool treeDirty = true;
+
+    //要画的环段，布局时算好，绘制和橡皮筋选择都用它
+    struct Segment
+    {
+        int node; //合并的细小节点为-1
+        int depth;
+        double start; //数值单位
+        double span;
+        QRgb color;
+    };
+    mutable QVector<Segment> segments;
+    mutable bool layoutDirty = true;
+
+    //缓存层：所有环段画好，paintEvent直接贴图
+    QPixmap layer;
+    bool layerDirty = true;
+
+    int margin = 10; //图与视口边缘的间距
+};
+
+#endif // SUNBURSTVIEW_H
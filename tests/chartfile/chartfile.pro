@@ -0,0 +1,20 @@
+QT += gui concurrent testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_chartfile
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_chartfile.cpp \
+    ../../chartfile.cpp \
+    ../../chartlabels.cpp \
+    ../../chartmodel.cpp \
+    ../../chartprofiler.cpp
+
+HEADERS += \
+    ../../chartfile.h \
+    ../../chartlabels.h \
+    ../../chartmodel.h \
+    ../../chartprofiler.h
@@ -0,0 +1,129 @@
+﻿#include <QBuffer>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+#include <cstddef>
+#include "chartfile.h"
+#pragma execution_character_set("utf-8")
+
+//.chtb文件头检查：完整的文件能读回，截断的文件和偏移损坏的文件头都被拒绝，不会越界读取
+class ChartFileTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void binaryRoundTrip();
+    void truncatedBinary();
+    void corruptOffsets_data();
+    void corruptOffsets();
+
+private:
+    static QByteArray sampleBinary();
+};
+
+//三行两个标签的二进制文件
+QByteArray ChartFileTest::sampleBinary()
+{
+    ChartData data;
+    data.append(QStringLiteral("苹果"),1.5,0xffff0000u);
+    data.append(QStringLiteral("香蕉"),2.0,0xff00ff00u);
+    data.append(QStringLiteral("苹果"),3.25,0xff0000ffu);
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    if(!ChartFile::writeBinary(&buffer,data))
+        return QByteArray();
+    return bytes;
+}
+
+void ChartFileTest::binaryRoundTrip()
+{
+    const QByteArray bytes = sampleBinary();
+    QVERIFY(!bytes.isEmpty());
+
+    ChartBinaryHeader header;
+    QVERIFY(ChartFile::binaryHeader(bytes.constData(),bytes.constData() + bytes.size(),&header));
+    QCOMPARE(header.rows,3u);
+    QCOMPARE(header.labels,2u);
+
+    QVector<quint32> ids;
+    const ChartLabels labels = ChartFile::binaryLabels(bytes.constData(),header,&ids);
+    ChartData data;
+    ChartFile::readBinaryRows(bytes.constData(),header,labels,ids,0,int(header.rows),&data);
+    QCOMPARE(data.size(),3);
+    QCOMPARE(data.label(0),QStringLiteral("苹果"));
+    QCOMPARE(data.label(1),QStringLiteral("香蕉"));
+    QCOMPARE(data.labelIds[0],data.labelIds[2]);
+    QCOMPARE(data.values[2],3.25);
+    QCOMPARE(data.colors[1],0xff00ff00u);
+}
+
+//文件被截断：无论文件头中的fileSize是否跟着改小，都不能通过检查
+void ChartFileTest::truncatedBinary()
+{
+    const QByteArray bytes = sampleBinary();
+    QVERIFY(!bytes.isEmpty());
+
+    ChartBinaryHeader header;
+    QString error;
+    for(int size = 0; size < bytes.size(); ++size){
+        QByteArray cut = bytes.left(size);
+        QVERIFY2(!ChartFile::binaryHeader(cut.constData(),cut.constData() + cut.size(),&header,&error),qPrintable(QString::number(size)));
+        if(size >= int(sizeof(ChartBinaryHeader))){
+            qToLittleEndian<quint64>(quint64(size),cut.data() + offsetof(ChartBinaryHeader,fileSize));
+            QVERIFY2(!ChartFile::binaryHeader(cut.constData(),cut.constData() + cut.size(),&header,&error),qPrintable(QString::number(size)));
+        }
+    }
+
+    //截断的文件从磁盘读取时返回错误
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QFile file(dir.filePath(QStringLiteral("cut.chtb")));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(bytes.left(bytes.size() - 2));
+    file.close();
+    ChartData data;
+    ChartLoadStats stats;
+    QVERIFY(!ChartFile::read(file.fileName(),&data,&stats,&error));
+    QVERIFY(!error.isEmpty());
+    QCOMPARE(data.size(),0);
+}
+
+void ChartFileTest::corruptOffsets_data()
+{
+    QTest::addColumn<int>("field");
+    QTest::addColumn<quint64>("offset");
+
+    const int fields[] = {int(offsetof(ChartBinaryHeader,valuesOffset)),int(offsetof(ChartBinaryHeader,colorsOffset)),
+                          int(offsetof(ChartBinaryHeader,labelIdsOffset)),int(offsetof(ChartBinaryHeader,labelIndexOffset)),
+                          int(offsetof(ChartBinaryHeader,labelDataOffset))};
+    const char *names[] = {"values","colors","labelIds","labelIndex","labelData"};
+    for(int i = 0; i < 5; ++i){
+        //加上长度后回绕到很小的数
+        QTest::newRow(QByteArray(names[i]).append(" wraps").constData()) << fields[i] << quint64(0) - 8;
+        QTest::newRow(QByteArray(names[i]).append(" max").constData()) << fields[i] << ~quint64(0);
+        QTest::newRow(QByteArray(names[i]).append(" inside header").constData()) << fields[i] << quint64(0);
+        QTest::newRow(QByteArray(names[i]).append(" unaligned").constData()) << fields[i] << quint64(sizeof(ChartBinaryHeader) + 4);
+        QTest::newRow(QByteArray(names[i]).append(" past end").constData()) << fields[i] << (quint64(1) << 40);
+    }
+}
+
+//文件头中的偏移被改坏：回绕、指向文件头内、未对齐或超出文件，都要拒绝
+void ChartFileTest::corruptOffsets()
+{
+    QFETCH(int,field);
+    QFETCH(quint64,offset);
+
+    QByteArray bytes = sampleBinary();
+    QVERIFY(!bytes.isEmpty());
+    qToLittleEndian<quint64>(offset,bytes.data() + field);
+
+    ChartBinaryHeader header;
+    QString error;
+    QVERIFY(!ChartFile::binaryHeader(bytes.constData(),bytes.constData() + bytes.size(),&header,&error));
+    QVERIFY(!error.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(ChartFileTest)
+
+#include "tst_chartfile.moc"
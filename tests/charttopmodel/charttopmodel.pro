@@ -0,0 +1,22 @@
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_charttopmodel
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_charttopmodel.cpp \
+    ../../chartlabels.cpp \
+    ../../chartmodel.cpp \
+    ../../chartprofiler.cpp \
+    ../../chartselectionlink.cpp \
+    ../../charttopmodel.cpp
+
+HEADERS += \
+    ../../chartlabels.h \
+    ../../chartmodel.h \
+    ../../chartprofiler.h \
+    ../../chartselectionlink.h \
+    ../../charttopmodel.h
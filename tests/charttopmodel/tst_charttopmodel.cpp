@@ -0,0 +1,123 @@
+﻿#include <QAbstractItemModelTester>
+#include <QItemSelectionModel>
+#include <QtTest>
+#include <algorithm>
+#include "chartmodel.h"
+#include "chartselectionlink.h"
+#include "charttopmodel.h"
+#pragma execution_character_set("utf-8")
+
+//前N行代理：末尾追加一批行后与重建的结果相同，一批只删除、插入各一段；选择经代理与源同步
+class ChartTopModelTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void appendBatch_data();
+    void appendBatch();
+    void linkedSelection();
+
+private:
+    static ChartData rows(const QVector<double> &values, int first);
+    //代理前N行的数值，从大到小
+    static QVector<double> topValues(const ChartTopModel &top);
+};
+
+ChartData ChartTopModelTest::rows(const QVector<double> &values, int first)
+{
+    ChartData data;
+    for(int i = 0; i < values.size(); ++i)
+        data.append(QStringLiteral("r%1").arg(first + i),values.at(i),0xff000000u);
+    return data;
+}
+
+QVector<double> ChartTopModelTest::topValues(const ChartTopModel &top)
+{
+    QVector<double> values;
+    int previous = -1;
+    for(int row = 0; row < top.rowCount(); ++row){
+        const QModelIndex source = top.mapToSource(top.index(row,1));
+        if(!source.isValid())
+            continue; //"其他"
+        if(source.row() <= previous)
+            QTest::qFail("前N行没有按行号排列",__FILE__,__LINE__);
+        previous = source.row();
+        values.append(source.data().toDouble());
+    }
+    std::sort(values.begin(),values.end(),std::greater<double>());
+    return values;
+}
+
+void ChartTopModelTest::appendBatch_data()
+{
+    QTest::addColumn<QVector<double>>("initial");
+    QTest::addColumn<QVector<double>>("appended");
+    QTest::addColumn<int>("limit");
+    QTest::addColumn<int>("maxRemoves"); //离开前N行的原有行连续时只删除一段
+
+    QTest::newRow("fill") << QVector<double>() << QVector<double>{5,1,4,2,3} << 3 << 0;
+    QTest::newRow("rising") << QVector<double>{1,2,3} << QVector<double>{4,5,6,7} << 3 << 1;
+    QTest::newRow("mixed") << QVector<double>{5,1,9,3} << QVector<double>{8,0,10,2,7} << 3 << 2;
+    QTest::newRow("ties") << QVector<double>{2,2,2} << QVector<double>{2,2} << 2 << 0;
+    QTest::newRow("below") << QVector<double>{9,8,7} << QVector<double>{1,2} << 3 << 0;
+    QTest::newRow("zero limit") << QVector<double>{1,2} << QVector<double>{3} << 0 << 0;
+}
+
+void ChartTopModelTest::appendBatch()
+{
+    QFETCH(QVector<double>,initial);
+    QFETCH(QVector<double>,appended);
+    QFETCH(int,limit);
+    QFETCH(int,maxRemoves);
+
+    ChartModel model;
+    model.setChartData(rows(initial,0));
+    ChartTopModel top;
+    top.setLimit(limit);
+    top.setSourceModel(&model);
+    QAbstractItemModelTester tester(&top,QAbstractItemModelTester::FailureReportingMode::QtTest);
+    QSignalSpy removed(&top,&QAbstractItemModel::rowsRemoved);
+    QSignalSpy inserted(&top,&QAbstractItemModel::rowsInserted);
+    QSignalSpy reset(&top,&QAbstractItemModel::modelReset);
+
+    model.appendChartData(rows(appended,initial.size()));
+    QCOMPARE(reset.count(),0);
+    QVERIFY(removed.count() <= maxRemoves);
+    QVERIFY(inserted.count() <= 2); //进入的新行一段，"其他"行一次
+
+    ChartTopModel rebuilt;
+    rebuilt.setLimit(limit);
+    rebuilt.setSourceModel(&model);
+    QCOMPARE(top.rowCount(),rebuilt.rowCount());
+    QCOMPARE(topValues(top),topValues(rebuilt));
+    QCOMPARE(top.otherValue(),rebuilt.otherValue());
+}
+
+//源选择中不在前N行的项在圆里看不到，圆中的选择变化也不会把它们取消
+void ChartTopModelTest::linkedSelection()
+{
+    ChartModel model;
+    model.setChartData(rows({5,1,9,3},0));
+    ChartTopModel top;
+    top.setLimit(2);
+    top.setSourceModel(&model);
+    QItemSelectionModel selection(&model);
+    ChartSelectionLink link(&selection,&top);
+    QItemSelectionModel *topSelection = link.proxySelectionModel();
+
+    selection.select(QItemSelection(model.index(0,0),model.index(1,1)),QItemSelectionModel::ClearAndSelect);
+    QVERIFY(topSelection->isSelected(top.mapFromSource(model.index(0,0))));
+
+    topSelection->select(top.mapFromSource(model.index(2,0)),QItemSelectionModel::Select);
+    QVERIFY(selection.isSelected(model.index(2,0)));
+    QVERIFY(selection.isSelected(model.index(1,0))); //第1行不在前2行中，仍然选中
+
+    //第1行变大换进前2行，重新映射后在圆中也选中
+    QVERIFY(model.setData(model.index(1,1),20.0));
+    QTRY_VERIFY(topSelection->isSelected(top.mapFromSource(model.index(1,0))));
+    QVERIFY(selection.isSelected(model.index(0,0)));
+}
+
+QTEST_GUILESS_MAIN(ChartTopModelTest)
+
+#include "tst_charttopmodel.moc"
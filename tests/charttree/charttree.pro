@@ -0,0 +1,24 @@
+QT += widgets testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_charttree
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_charttree.cpp \
+    ../../chartlabels.cpp \
+    ../../chartmodel.cpp \
+    ../../chartprofiler.cpp \
+    ../../chartselectionlink.cpp \
+    ../../charttreemodel.cpp \
+    ../../sunburstview.cpp
+
+HEADERS += \
+    ../../chartlabels.h \
+    ../../chartmodel.h \
+    ../../chartprofiler.h \
+    ../../chartselectionlink.h \
+    ../../charttreemodel.h \
+    ../../sunburstview.h
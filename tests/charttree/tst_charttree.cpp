@@ -0,0 +1,190 @@
+﻿#include <QAbstractItemModelTester>
+#include <QItemSelectionModel>
+#include <QtTest>
+#include "chartmodel.h"
+#include "chartselectionlink.h"
+#include "charttreemodel.h"
+#include "sunburstview.h"
+#pragma execution_character_set("utf-8")
+
+//按标签分组的树形代理和旭日图：深层叶子的数值变化后，代理中分组的和与旭日图的子树总值都要跟着改
+class ChartTreeTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void grouping();
+    void deepLeafValue();
+    void appendRows();
+    void relabel();
+    void renameLeaf();
+    void linkedSelection();
+
+private:
+    //按名称逐层找代理中的项
+    QModelIndex find(const QStringList &path) const;
+    double sum(const QStringList &path) const;
+
+    ChartModel *model = nullptr;
+    ChartTreeModel *tree = nullptr;
+    QAbstractItemModelTester *tester = nullptr;
+};
+
+void ChartTreeTest::init()
+{
+    ChartData data;
+    data.append(QStringLiteral("水果/苹果/红富士"),5,0xffff0000u);
+    data.append(QStringLiteral("水果/苹果/国光"),3,0xffff8000u);
+    data.append(QStringLiteral("水果/香蕉"),4,0xffffff00u);
+    data.append(QStringLiteral("蔬菜/白菜"),2,0xff00ff00u);
+    model = new ChartModel;
+    model->setChartData(std::move(data));
+    tree = new ChartTreeModel;
+    tree->setSourceModel(model);
+    tester = new QAbstractItemModelTester(tree,QAbstractItemModelTester::FailureReportingMode::QtTest);
+}
+
+void ChartTreeTest::cleanup()
+{
+    delete tester;
+    delete tree;
+    delete model;
+}
+
+QModelIndex ChartTreeTest::find(const QStringList &path) const
+{
+    QModelIndex parent;
+    for(const QString &name : path){
+        const QModelIndexList found = tree->match(tree->index(0,0,parent),Qt::DisplayRole,name,1,Qt::MatchExactly);
+        if(found.isEmpty())
+            return QModelIndex();
+        parent = found.first();
+    }
+    return parent;
+}
+
+double ChartTreeTest::sum(const QStringList &path) const
+{
+    const QModelIndex index = find(path);
+    return index.sibling(index.row(),1).data().toDouble();
+}
+
+void ChartTreeTest::grouping()
+{
+    QCOMPARE(tree->rowCount(),2);
+    const QModelIndex fruit = find({QStringLiteral("水果")});
+    const QModelIndex apple = find({QStringLiteral("水果"),QStringLiteral("苹果")});
+    QCOMPARE(tree->rowCount(fruit),2);
+    QCOMPARE(tree->rowCount(apple),2);
+    QVERIFY(!tree->mapToSource(apple).isValid());
+    QCOMPARE(tree->mapFromSource(model->index(1,0)),find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("国光")}));
+    QCOMPARE(sum({QStringLiteral("水果")}),12.0);
+    QCOMPARE(sum({QStringLiteral("水果"),QStringLiteral("苹果")}),8.0);
+    QCOMPARE(sum({QStringLiteral("蔬菜")}),2.0);
+}
+
+//改第三层的叶子：代理沿路径修正分组的和，旭日图沿路径修正子树总值，与重新读取的结果相同
+void ChartTreeTest::deepLeafValue()
+{
+    SunburstView view;
+    view.setModel(tree);
+    const QModelIndex fruit = find({QStringLiteral("水果")});
+    const QModelIndex apple = find({QStringLiteral("水果"),QStringLiteral("苹果")});
+    QCOMPARE(view.itemTotal(apple),8.0); //先建好旭日图的节点缓存，之后走增量修正
+
+    QSignalSpy changed(tree,&QAbstractItemModel::dataChanged);
+    QVERIFY(model->setData(model->index(0,1),10.0));
+    QCOMPARE(sum({QStringLiteral("水果"),QStringLiteral("苹果")}),13.0);
+    QCOMPARE(sum({QStringLiteral("水果")}),17.0);
+    QCOMPARE(sum({QStringLiteral("蔬菜")}),2.0);
+    //叶子一次，两层分组各一次
+    QCOMPARE(changed.count(),3);
+
+    QCOMPARE(view.itemTotal(tree->mapFromSource(model->index(0,0))),10.0);
+    QCOMPARE(view.itemTotal(apple),13.0);
+    QCOMPARE(view.itemTotal(fruit),17.0);
+    QCOMPARE(view.itemTotal(QModelIndex()),19.0);
+
+    SunburstView fresh;
+    fresh.setModel(tree);
+    QCOMPARE(fresh.itemTotal(apple),view.itemTotal(apple));
+    QCOMPARE(fresh.itemTotal(fruit),view.itemTotal(fruit));
+
+    //负数按0算
+    QVERIFY(model->setData(model->index(1,1),-3.0));
+    QCOMPARE(sum({QStringLiteral("水果"),QStringLiteral("苹果")}),10.0);
+    QCOMPARE(view.itemTotal(apple),10.0);
+}
+
+//末尾追加：新分组和叶子增量插入，已有分组的和增加
+void ChartTreeTest::appendRows()
+{
+    QSignalSpy reset(tree,&QAbstractItemModel::modelReset);
+    QSignalSpy inserted(tree,&QAbstractItemModel::rowsInserted);
+    ChartData data;
+    data.append(QStringLiteral("蔬菜/萝卜/白萝卜"),1,0xff808080u);
+    data.append(QStringLiteral("水果/苹果/嘎啦"),6,0xff800000u);
+    model->appendChartData(data);
+
+    QCOMPARE(reset.count(),0);
+    QCOMPARE(inserted.count(),3); //萝卜、白萝卜、嘎啦
+    QCOMPARE(sum({QStringLiteral("蔬菜")}),3.0);
+    QCOMPARE(sum({QStringLiteral("蔬菜"),QStringLiteral("萝卜")}),1.0);
+    QCOMPARE(sum({QStringLiteral("水果"),QStringLiteral("苹果")}),14.0);
+    QCOMPARE(tree->mapFromSource(model->index(5,0)),find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("嘎啦")}));
+
+    //同一父节点下的一批新叶子只发出一次行插入
+    ChartData many;
+    for(int i = 0; i < 100; ++i)
+        many.append(QStringLiteral("水果/苹果/%1").arg(i),1,0xff000000u);
+    inserted.clear();
+    model->appendChartData(many);
+    QCOMPARE(inserted.count(),1);
+    QCOMPARE(tree->rowCount(find({QStringLiteral("水果"),QStringLiteral("苹果")})),103);
+    QCOMPARE(sum({QStringLiteral("水果"),QStringLiteral("苹果")}),114.0);
+}
+
+//改标签换了分组时重建
+void ChartTreeTest::relabel()
+{
+    QVERIFY(model->setData(model->index(3,0),QStringLiteral("水果/白菜")));
+    QCOMPARE(tree->rowCount(),1);
+    QCOMPARE(sum({QStringLiteral("水果")}),14.0);
+    QVERIFY(find({QStringLiteral("水果"),QStringLiteral("白菜")}).isValid());
+}
+
+void ChartTreeTest::renameLeaf()
+{
+    const QModelIndex leaf = find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("国光")});
+    QVERIFY(tree->setData(leaf,QStringLiteral("富士")));
+    QCOMPARE(model->index(1,0).data().toString(),QStringLiteral("水果/苹果/富士"));
+    QVERIFY(find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("富士")}).isValid());
+}
+
+//表格的选择映射到旭日图，旭日图中的选择映射回表格
+void ChartTreeTest::linkedSelection()
+{
+    QItemSelectionModel selection(model);
+    ChartSelectionLink link(&selection,tree);
+    QItemSelectionModel *treeSelection = link.proxySelectionModel();
+
+    selection.select(model->index(1,0),QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+    const QModelIndex leaf = find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("国光")});
+    QVERIFY(treeSelection->isSelected(leaf));
+    QVERIFY(!treeSelection->isSelected(find({QStringLiteral("水果"),QStringLiteral("香蕉")})));
+
+    treeSelection->select(find({QStringLiteral("水果"),QStringLiteral("香蕉")}),QItemSelectionModel::Select);
+    QVERIFY(selection.isSelected(model->index(2,0)));
+    QVERIFY(selection.isSelected(model->index(1,0)));
+
+    //代理重建后从表格的选择重新映射
+    QVERIFY(model->setData(model->index(3,0),QStringLiteral("水果/白菜")));
+    QVERIFY(selection.isSelected(model->index(1,0)));
+    QTRY_VERIFY(treeSelection->isSelected(find({QStringLiteral("水果"),QStringLiteral("苹果"),QStringLiteral("国光")})));
+}
+
+QTEST_MAIN(ChartTreeTest)
+
+#include "tst_charttree.moc"